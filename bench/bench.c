@@ -0,0 +1,289 @@
+// SPDX-License-Identifier: GPL-3.0-or-later
+// Copyright 2024 neov5
+
+// brightnes-bench: runs a ROM headless as fast as it can and reports how
+// quickly frames and cycles go by. Given a joypad recording and the frame
+// hashes from brightnes it replays the run and reports the first frame that
+// came out different
+
+#include "nes.h"
+#include "disp.h"
+#include "jit.h"
+#include "log.h"
+#include "parse_args.h"
+#include "rewind.h"
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+extern nes_state_t state;
+
+static double bench_now() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+typedef struct {
+    u64 *input;
+    unsigned long n_input;
+    u64 *golden;
+    unsigned long n_golden;
+    FILE *hashes_file;
+    long divergent;
+    rewind_t *rw; // NULL if not recording rewind history
+    double rewind_s; // spent in rewind_push
+    u32 ahead; // run-ahead frames
+} bench_run_t;
+
+static void bench_frame(bench_run_t *run, unsigned long frame) {
+    if (run->input) state.joypad.state = frame < run->n_input ? run->input[frame] : 0;
+    if (run->rw) {
+        double t = bench_now();
+        rewind_push(run->rw);
+        run->rewind_s += bench_now() - t;
+    }
+    nes_render_frame_ahead(run->ahead);
+    if (run->hashes_file) fprintf(run->hashes_file, "%016" PRIx64 "\n", disp_frame_hash());
+    if (run->golden && run->divergent < 0 && frame < run->n_golden &&
+        run->golden[frame] != disp_frame_hash()) {
+        run->divergent = frame;
+    }
+}
+
+static int bench_cmp_double(const void *a, const void *b) {
+    double x = *(const double*)a, y = *(const double*)b;
+    return (x > y) - (x < y);
+}
+
+static void bench_print_json_string(const char *s) {
+    putchar('"');
+    for (; *s; s++) {
+        if (*s == '"' || *s == '\\') putchar('\\');
+        putchar(*s);
+    }
+    putchar('"');
+}
+
+// Reads a file of hex numbers, one per line, like brightnes -r/-H write them
+static u64 *bench_read_hex(const char *path, unsigned long *count) {
+    FILE *f = fopen(path, "r");
+    if (f == NULL) {
+        log_fatal("Could not open %s for reading: %s", path, strerror(errno));
+        exit(1);
+    }
+    unsigned long n = 0, cap = 1024;
+    u64 *vals = malloc(cap * sizeof(u64));
+    u64 val;
+    while (vals != NULL && fscanf(f, "%" SCNx64, &val) == 1) {
+        if (n == cap) vals = realloc(vals, (cap *= 2) * sizeof(u64));
+        if (vals != NULL) vals[n++] = val;
+    }
+    if (vals == NULL) {
+        log_fatal("Could not allocate memory for %s", path);
+        exit(1);
+    }
+    fclose(f);
+    *count = n;
+    return vals;
+}
+
+int main(int argc, char** argv) {
+
+    char *rom_path = NULL;
+    char *cpu_backend = NULL;
+    unsigned long frames = 600;
+    unsigned long warmup = 60;
+    int json = 0;
+    char *input_path = NULL;
+    char *hashes_path = NULL;
+    char *golden_path = NULL;
+    unsigned long rewind_mb = 0;
+    unsigned int run_ahead = 0;
+    char *ppu_mode = NULL;
+
+    args_option_t options[] = {
+        ARGS_POSITIONAL_ARG(ARGTYPE_STRING, &rom_path),
+        ARGS_OPTION("-c", "--cpu", ARGTYPE_STRING, &cpu_backend),
+        ARGS_OPTION("-n", "--frames", ARGTYPE_ULONG, &frames),
+        ARGS_OPTION("-w", "--warmup", ARGTYPE_ULONG, &warmup),
+        ARGS_FLAG("-j", "--json", &json),
+        ARGS_OPTION("-i", "--input", ARGTYPE_STRING, &input_path),
+        ARGS_OPTION("-H", "--hashes", ARGTYPE_STRING, &hashes_path),
+        ARGS_OPTION("-g", "--golden", ARGTYPE_STRING, &golden_path),
+        ARGS_OPTION("-R", "--rewind", ARGTYPE_ULONG, &rewind_mb),
+        ARGS_OPTION("-a", "--run-ahead", ARGTYPE_UINT, &run_ahead),
+        ARGS_OPTION("-P", "--ppu", ARGTYPE_STRING, &ppu_mode),
+        ARGS_END_OF_OPTIONS
+    };
+
+    int args_err = parse_arguments(argc, argv, options);
+
+    // by ppu_renderer_t
+    static const char *const ppu_modes[] = { "auto", "dot", "scanline" };
+    int renderer = PPU_RENDER_AUTO;
+    bool all_modes = ppu_mode != NULL && strcmp(ppu_mode, "all") == 0;
+    if (ppu_mode != NULL && !all_modes) {
+        for (renderer = 0; renderer < 3 && strcmp(ppu_mode, ppu_modes[renderer]); renderer++);
+    }
+
+    // frames shown with run-ahead come from a made up future, and the
+    // scanline renderer can draw differently, they can't match a recording
+    if (args_err < 0 || frames == 0 ||
+        (run_ahead && golden_path != NULL) || renderer == 3 ||
+        (all_modes && (run_ahead || golden_path != NULL)) ||
+        (cpu_backend != NULL && strcmp(cpu_backend, "interp") && strcmp(cpu_backend, "jit"))) {
+        printf("usage: brightnes-bench <rom_path> [-c|--cpu interp|jit] [-n|--frames count] "
+               "[-w|--warmup count] [-j|--json] [-i|--input input_path] "
+               "[-H|--hashes hashes_path] [-g|--golden hashes_path] [-R|--rewind megabytes] "
+               "[-a|--run-ahead frames] [-P|--ppu auto|dot|scanline|all]\n");
+        return 1;
+    }
+    if (cpu_backend == NULL) cpu_backend = "interp";
+    ppu_set_renderer(renderer);
+
+    // the scanline renderer picks a vector mux, it has to draw what the
+    // scalar one would
+    if (!ppu_mux_self_check()) {
+        log_fatal("The ppu line muxes disagree");
+        return 1;
+    }
+
+    disp_set_backend("null");
+    nes_init(rom_path);
+    if (strcmp(cpu_backend, "jit") == 0 && !nes_set_cpu_backend(NES_CPU_JIT)) {
+        log_fatal("Could not start the JIT");
+        return 1;
+    }
+
+    // frames are numbered from the start, warmup included, to line up with
+    // what brightnes recorded
+    bench_run_t run = { .divergent = -1 };
+    if (input_path) run.input = bench_read_hex(input_path, &run.n_input);
+    if (golden_path) run.golden = bench_read_hex(golden_path, &run.n_golden);
+    if (hashes_path && (run.hashes_file = fopen(hashes_path, "w")) == NULL) {
+        log_fatal("Could not open %s for writing: %s", hashes_path, strerror(errno));
+        return 1;
+    }
+    disp_hash_frames(run.golden != NULL || run.hashes_file != NULL);
+
+    // rewind history is recorded every frame, like when playing
+    rewind_t rw;
+    if (rewind_mb) {
+        if (!rewind_init(&rw, rewind_mb << 20, REWIND_KEY_INTERVAL)) return 1;
+        run.rw = &rw;
+    }
+
+    for (unsigned long i=0; i<warmup; i++) bench_frame(&run, i);
+
+    double *frame_time = malloc(frames * sizeof(double));
+    if (frame_time == NULL) {
+        log_fatal("Could not allocate frame times");
+        return 1;
+    }
+
+    // the same number of plain frames first, to tell what run-ahead adds
+    double base_wall = 0;
+    unsigned long frame = warmup;
+    if (run_ahead) {
+        double base_start = bench_now();
+        for (unsigned long i=0; i<frames; i++) bench_frame(&run, frame++);
+        base_wall = bench_now() - base_start;
+        run.ahead = run_ahead;
+    }
+
+    // with all of them, dot and scanline get the same number of frames before
+    // the run in auto
+    double mode_fps[3] = {0};
+    if (all_modes) {
+        for (int m = PPU_RENDER_DOT; m <= PPU_RENDER_SCANLINE; m++) {
+            ppu_set_renderer(m);
+            double mode_start = bench_now();
+            for (unsigned long i=0; i<frames; i++) bench_frame(&run, frame++);
+            mode_fps[m] = frames / (bench_now() - mode_start);
+        }
+        ppu_set_renderer(PPU_RENDER_AUTO);
+    }
+
+    u64 cpu_start = state.cpu_st.cycles;
+    u64 ppu_start = state.ppu_cycle;
+    u64 idle_start = state.cpu_st.idle_cycles_skipped;
+    jit_t *jit = state.cpu_st.jit;
+    u64 run_start = jit ? jit->blocks_run : 0;
+    run.rewind_s = 0;
+    double start = bench_now(), tic = start;
+    for (unsigned long i=0; i<frames; i++) {
+        bench_frame(&run, frame++);
+        double toc = bench_now();
+        frame_time[i] = toc - tic;
+        tic = toc;
+    }
+    double wall = tic - start;
+    u64 cpu_cycles = state.cpu_st.cycles - cpu_start;
+    u64 ppu_cycles = state.ppu_cycle - ppu_start;
+    u64 idle_cycles = state.cpu_st.idle_cycles_skipped - idle_start;
+    u64 blocks_translated = jit ? jit->blocks_translated : 0; // warmup included
+    u64 blocks_run = jit ? jit->blocks_run - run_start : 0;
+
+    qsort(frame_time, frames, sizeof(double), &bench_cmp_double);
+    double min_ms = frame_time[0] * 1e3;
+    double median_ms = frame_time[frames/2] * 1e3;
+    double p99_ms = frame_time[(frames*99 + 99)/100 - 1] * 1e3;
+    double rewind_ms = run.rewind_s / frames * 1e3;
+    double ahead_ms = run_ahead ? (wall - base_wall) / frames / run_ahead * 1e3 : 0;
+    mode_fps[PPU_RENDER_AUTO] = frames / wall;
+
+    if (json) {
+        printf("{\"rom\": ");
+        bench_print_json_string(rom_path);
+        printf(", \"cpu\": \"%s\", \"ppu\": \"%s\", \"frames\": %lu, \"wall_s\": %.6f, \"fps\": %.2f, "
+               "\"cpu_cycles_per_s\": %.0f, \"ppu_cycles_per_s\": %.0f, "
+               "\"frame_ms\": {\"min\": %.4f, \"median\": %.4f, \"p99\": %.4f}, "
+               "\"idle_cycles_skipped\": %llu",
+               cpu_backend, all_modes ? "all" : ppu_modes[renderer], frames, wall, frames / wall,
+               cpu_cycles / wall, ppu_cycles / wall,
+               min_ms, median_ms, p99_ms, (unsigned long long)idle_cycles);
+        if (jit) printf(", \"jit_blocks_translated\": %llu, \"jit_blocks_run\": %llu",
+                        (unsigned long long)blocks_translated, (unsigned long long)blocks_run);
+        if (run_ahead) printf(", \"run_ahead\": %u, \"run_ahead_ms_per_frame\": %.4f", run_ahead, ahead_ms);
+        if (all_modes) printf(", \"ppu_fps\": {\"dot\": %.2f, \"scanline\": %.2f, \"auto\": %.2f}",
+                              mode_fps[PPU_RENDER_DOT], mode_fps[PPU_RENDER_SCANLINE], mode_fps[PPU_RENDER_AUTO]);
+        if (run.rw) printf(", \"rewind_frames\": %u, \"rewind_bytes\": %u, \"rewind_ms_per_frame\": %.4f, "
+                           "\"rewind_frame_pct\": %.2f",
+                           rw.count, rewind_bytes(&rw), rewind_ms, run.rewind_s / wall * 100);
+        if (run.golden) printf(", \"first_divergent_frame\": %ld", run.divergent);
+        printf("}\n");
+    }
+    else {
+        printf("%s (%s, %s ppu), %lu frames in %.3f s\n", rom_path, cpu_backend,
+               all_modes ? "auto" : ppu_modes[renderer], frames, wall);
+        printf("  %.2f frames/s\n", frames / wall);
+        printf("  %.0f cpu cycles/s, %.0f ppu cycles/s\n", cpu_cycles / wall, ppu_cycles / wall);
+        printf("  frame time min %.4f ms, median %.4f ms, p99 %.4f ms\n", min_ms, median_ms, p99_ms);
+        printf("  %llu idle cpu cycles skipped\n", (unsigned long long)idle_cycles);
+        if (jit) printf("  %llu jit blocks translated (warmup included), %llu run\n",
+                        (unsigned long long)blocks_translated, (unsigned long long)blocks_run);
+        if (run_ahead) printf("  run-ahead of %u frames, %.4f ms more per frame ahead\n", run_ahead, ahead_ms);
+        if (all_modes) {
+            printf("  ppu dot %.2f frames/s, scanline %.2f (x%.2f), auto %.2f (x%.2f)\n",
+                   mode_fps[PPU_RENDER_DOT], mode_fps[PPU_RENDER_SCANLINE],
+                   mode_fps[PPU_RENDER_SCANLINE] / mode_fps[PPU_RENDER_DOT],
+                   mode_fps[PPU_RENDER_AUTO], mode_fps[PPU_RENDER_AUTO] / mode_fps[PPU_RENDER_DOT]);
+        }
+        if (run.rw) printf("  %u frames of rewind history in %u bytes, recording %.4f ms per frame (%.2f%% of frame time)\n",
+                           rw.count, rewind_bytes(&rw), rewind_ms, run.rewind_s / wall * 100);
+        if (run.golden && run.divergent >= 0) printf("  frame %ld differs from %s\n", run.divergent, golden_path);
+        else if (run.golden) printf("  all frames match %s\n", golden_path);
+    }
+
+    if (run.hashes_file) fclose(run.hashes_file);
+    if (run.rw) rewind_free(run.rw);
+    free(run.input);
+    free(run.golden);
+    free(frame_time);
+    nes_exit();
+
+    return run.divergent >= 0;
+}
@@ -2,43 +2,72 @@
 // Copyright 2024 neov5
 
 #include "cpu.h"
+#include "jit.h"
 #include "log.h"
 #include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
 #include <stdbool.h>
 
 #define hi(u) (((u16)(u))<<8)
 #define lo(u) ((u)&0xFF)
 
+// The addressing mode helpers and operations are forced into each opcode
+// handler, so every opcode ends up fully specialized with no calls left on
+// the hot path other than the bus.
+#if defined(__GNUC__) || defined(__clang__)
+#define CPU_INLINE static inline __attribute__((always_inline))
+#define CPU_COMPUTED_GOTO
+#else
+#define CPU_INLINE static inline
+#endif
+
 void cpu_state_to_str(cpu_state_t* st, char buf[64]) {
     snprintf(buf, 64, "[CPU A:%02hhx X:%02hhx Y:%02hhx PC:%04hx S:%02hhx P:%02hhx]", 
-            st->A, st->X, st->Y, st->PC, st->S, st->P.data);
+            st->A, st->X, st->Y, st->PC, st->S, cpu_get_p(st));
+}
+
+u8 cpu_get_p(const cpu_state_t *st) {
+    cpu_sr_t sr = st->P;
+    sr.N = st->_n >> 7;
+    sr.Z = (st->_z == 0);
+    sr.C = st->_c;
+    sr.V = st->_v;
+    return sr.data;
+}
+
+void cpu_set_p(cpu_state_t *st, u8 p) {
+    st->P.data = p;
+    st->_n = p & 0x80;
+    st->_z = !(p & 0x02);
+    st->_c = p & 0x01;
+    st->_v = (p >> 6) & 0x01;
 }
 
 
-void cpu_set_nz(cpu_state_t* st, u8 val) {
-    st->P.N = (val >> 7);
-    st->P.Z = (val == 0);
+CPU_INLINE void cpu_set_nz(cpu_state_t* st, u8 val) {
+    st->_n = st->_z = val;
 }
 
 // read instructions
-void cpu_instr_lda(cpu_state_t* st, u8 op) { st->A = op; cpu_set_nz(st, op); }
-void cpu_instr_ldx(cpu_state_t* st, u8 op) { st->X = op; cpu_set_nz(st, op); }
-void cpu_instr_ldy(cpu_state_t* st, u8 op) { st->Y = op; cpu_set_nz(st, op); }
-void cpu_instr_ora(cpu_state_t* st, u8 op) { cpu_instr_lda(st, st->A | op); }
-void cpu_instr_eor(cpu_state_t* st, u8 op) { cpu_instr_lda(st, st->A ^ op); }
-void cpu_instr_and(cpu_state_t* st, u8 op) { cpu_instr_lda(st, st->A & op); }
-void cpu_instr_cmp(cpu_state_t* st, u8 op) { cpu_set_nz(st, st->A - op); st->P.C = (op <= st->A); }
-void cpu_instr_cpx(cpu_state_t* st, u8 op) { cpu_set_nz(st, st->X - op); st->P.C = (op <= st->X); }
-void cpu_instr_cpy(cpu_state_t* st, u8 op) { cpu_set_nz(st, st->Y - op); st->P.C = (op <= st->Y); }
-void cpu_instr_adc(cpu_state_t* st, u8 op) {
-    u16 res = (u16)(op) + (u16)(st->A) + (u16)(st->P.C);
-    st->P.C = (res > (u16)(0xFF));
-    st->P.V = ((op^lo(res))&(st->A^lo(res))&0x80) > 0;
+CPU_INLINE void cpu_instr_lda(cpu_state_t* st, u8 op) { st->A = op; cpu_set_nz(st, op); }
+CPU_INLINE void cpu_instr_ldx(cpu_state_t* st, u8 op) { st->X = op; cpu_set_nz(st, op); }
+CPU_INLINE void cpu_instr_ldy(cpu_state_t* st, u8 op) { st->Y = op; cpu_set_nz(st, op); }
+CPU_INLINE void cpu_instr_ora(cpu_state_t* st, u8 op) { cpu_instr_lda(st, st->A | op); }
+CPU_INLINE void cpu_instr_eor(cpu_state_t* st, u8 op) { cpu_instr_lda(st, st->A ^ op); }
+CPU_INLINE void cpu_instr_and(cpu_state_t* st, u8 op) { cpu_instr_lda(st, st->A & op); }
+CPU_INLINE void cpu_instr_cmp(cpu_state_t* st, u8 op) { cpu_set_nz(st, st->A - op); st->_c = (op <= st->A); }
+CPU_INLINE void cpu_instr_cpx(cpu_state_t* st, u8 op) { cpu_set_nz(st, st->X - op); st->_c = (op <= st->X); }
+CPU_INLINE void cpu_instr_cpy(cpu_state_t* st, u8 op) { cpu_set_nz(st, st->Y - op); st->_c = (op <= st->Y); }
+CPU_INLINE void cpu_instr_adc(cpu_state_t* st, u8 op) {
+    u16 res = (u16)(op) + (u16)(st->A) + (u16)(st->_c);
+    st->_c = (res > (u16)(0xFF));
+    st->_v = ((op^lo(res))&(st->A^lo(res))&0x80) > 0;
     cpu_set_nz(st, (u8)(res & 0xFF));
     st->A = (u8)res;
 }
 // hack learnt from 6502.org
-void cpu_instr_sbc(cpu_state_t* st, u8 op) { 
+CPU_INLINE void cpu_instr_sbc(cpu_state_t* st, u8 op) { 
     cpu_instr_adc(st, ~op);
     // u16 res = (u16)(st->A) - (u16)op - (u16)(st->P.C ^ 0x1);
     // printf("0x%x\n", res);
@@ -47,329 +76,626 @@ void cpu_instr_sbc(cpu_state_t* st, u8 op) {
     // cpu_set_nz(st, res);
     // st->A = (u8)res;
 }
-void cpu_instr_bit(cpu_state_t* st, u8 op) { 
-    st->P.N = (op & 0x80)>>7;
-    st->P.V = (op & 0x40)>>6;
-    st->P.Z = ((op & st->A) == 0);
+CPU_INLINE void cpu_instr_bit(cpu_state_t* st, u8 op) { 
+    st->_n = op;
+    st->_v = (op & 0x40)>>6;
+    st->_z = op & st->A;
 }
 
 // rmw instructions
-u8 cpu_instr_dec(cpu_state_t* st, u8 op) { cpu_set_nz(st, op-1); return op-1; }
-u8 cpu_instr_inc(cpu_state_t* st, u8 op) { cpu_set_nz(st, op+1); return op+1; }
-u8 cpu_instr_asl(cpu_state_t* st, u8 op) { st->P.C = (op&0x80)>>7; cpu_set_nz(st, (u8)(op<<1)); return op<<1; }
-u8 cpu_instr_lsr(cpu_state_t* st, u8 op) { st->P.C = (op&0x01); cpu_set_nz(st, (u8)(op>>1)); return op>>1; }
-u8 cpu_instr_rol(cpu_state_t* st, u8 op) { 
-    u8 sbit = st->P.C;
-    st->P.C = (op&0x80)>>7; 
+CPU_INLINE u8 cpu_instr_dec(cpu_state_t* st, u8 op) { cpu_set_nz(st, op-1); return op-1; }
+CPU_INLINE u8 cpu_instr_inc(cpu_state_t* st, u8 op) { cpu_set_nz(st, op+1); return op+1; }
+CPU_INLINE u8 cpu_instr_asl(cpu_state_t* st, u8 op) { st->_c = (op&0x80)>>7; cpu_set_nz(st, (u8)(op<<1)); return op<<1; }
+CPU_INLINE u8 cpu_instr_lsr(cpu_state_t* st, u8 op) { st->_c = (op&0x01); cpu_set_nz(st, (u8)(op>>1)); return op>>1; }
+CPU_INLINE u8 cpu_instr_rol(cpu_state_t* st, u8 op) { 
+    u8 sbit = st->_c;
+    st->_c = (op&0x80)>>7; 
     u8 res = (u8)(op<<1) | sbit;
     cpu_set_nz(st, res); 
     return res; 
 }
-u8 cpu_instr_ror(cpu_state_t* st, u8 op) { 
-    u8 sbit = st->P.C;
-    st->P.C = (op&0x01); 
+CPU_INLINE u8 cpu_instr_ror(cpu_state_t* st, u8 op) { 
+    u8 sbit = st->_c;
+    st->_c = (op&0x01); 
     u8 res = (u8)(op>>1) | (sbit << 7);
     cpu_set_nz(st, res);
     return res; 
 }
 
 // write instructions
-u8 cpu_instr_sta(cpu_state_t* st) { return st->A; }
-u8 cpu_instr_stx(cpu_state_t* st) { return st->X; }
-u8 cpu_instr_sty(cpu_state_t* st) { return st->Y; }
+CPU_INLINE u8 cpu_instr_sta(cpu_state_t* st) { return st->A; }
+CPU_INLINE u8 cpu_instr_stx(cpu_state_t* st) { return st->X; }
+CPU_INLINE u8 cpu_instr_sty(cpu_state_t* st) { return st->Y; }
 
 // implied instructions
-void cpu_instr_clc(cpu_state_t* st) { st->P.C = 0; }
-void cpu_instr_cld(cpu_state_t* st) { st->P.D = 0; }
-void cpu_instr_cli(cpu_state_t* st) { st->P.I = 0; }
-void cpu_instr_clv(cpu_state_t* st) { st->P.V = 0; }
-void cpu_instr_sec(cpu_state_t* st) { st->P.C = 1; }
-void cpu_instr_sed(cpu_state_t* st) { st->P.D = 1; }
-void cpu_instr_sei(cpu_state_t* st) { st->P.I = 1; }
-void cpu_instr_tax(cpu_state_t *st) { cpu_instr_ldx(st, st->A); }
-void cpu_instr_tay(cpu_state_t *st) { cpu_instr_ldy(st, st->A); }
-void cpu_instr_tsx(cpu_state_t *st) { cpu_instr_ldx(st, st->S); }
-void cpu_instr_txa(cpu_state_t *st) { cpu_instr_lda(st, st->X); }
-void cpu_instr_tya(cpu_state_t *st) { cpu_instr_lda(st, st->Y); }
-void cpu_instr_txs(cpu_state_t *st) { st->S = st->X; }
-void cpu_instr_dex(cpu_state_t *st) { cpu_instr_ldx(st, st->X-1); }
-void cpu_instr_dey(cpu_state_t *st) { cpu_instr_ldy(st, st->Y-1); }
-void cpu_instr_inx(cpu_state_t *st) { cpu_instr_ldx(st, st->X+1); }
-void cpu_instr_iny(cpu_state_t *st) { cpu_instr_ldy(st, st->Y+1); }
-void cpu_instr_nop(cpu_state_t *st) { /* do nothing */ }
+CPU_INLINE void cpu_instr_clc(cpu_state_t* st) { st->_c = 0; }
+CPU_INLINE void cpu_instr_cld(cpu_state_t* st) { st->P.D = 0; }
+CPU_INLINE void cpu_instr_cli(cpu_state_t* st) { st->P.I = 0; }
+CPU_INLINE void cpu_instr_clv(cpu_state_t* st) { st->_v = 0; }
+CPU_INLINE void cpu_instr_sec(cpu_state_t* st) { st->_c = 1; }
+CPU_INLINE void cpu_instr_sed(cpu_state_t* st) { st->P.D = 1; }
+CPU_INLINE void cpu_instr_sei(cpu_state_t* st) { st->P.I = 1; }
+CPU_INLINE void cpu_instr_tax(cpu_state_t *st) { cpu_instr_ldx(st, st->A); }
+CPU_INLINE void cpu_instr_tay(cpu_state_t *st) { cpu_instr_ldy(st, st->A); }
+CPU_INLINE void cpu_instr_tsx(cpu_state_t *st) { cpu_instr_ldx(st, st->S); }
+CPU_INLINE void cpu_instr_txa(cpu_state_t *st) { cpu_instr_lda(st, st->X); }
+CPU_INLINE void cpu_instr_tya(cpu_state_t *st) { cpu_instr_lda(st, st->Y); }
+CPU_INLINE void cpu_instr_txs(cpu_state_t *st) { st->S = st->X; }
+CPU_INLINE void cpu_instr_dex(cpu_state_t *st) { cpu_instr_ldx(st, st->X-1); }
+CPU_INLINE void cpu_instr_dey(cpu_state_t *st) { cpu_instr_ldy(st, st->Y-1); }
+CPU_INLINE void cpu_instr_inx(cpu_state_t *st) { cpu_instr_ldx(st, st->X+1); }
+CPU_INLINE void cpu_instr_iny(cpu_state_t *st) { cpu_instr_ldy(st, st->Y+1); }
+CPU_INLINE void cpu_instr_nop(cpu_state_t *st) { /* do nothing */ }
 
 // multi-cycle implied instructions 
-void cpu_instr_pha(cpu_state_t *st) {
-    st->tick(); // 2 
-    st->bus_write(st->A, 0x100+(st->S--));
-}
-void cpu_instr_php(cpu_state_t *st) {
-    st->tick(); // 2 
-    st->bus_write(*(u8*)(&st->P), 0x100+(st->S--));
-}
-void cpu_instr_pla(cpu_state_t *st) {
-    st->tick(); // 2
-    st->S++; st->tick(); // 3
-    st->A = st->bus_read(0x100+st->S);
+CPU_INLINE void cpu_instr_pha(cpu_state_t *st) {
+    cpu_tick(st); // 2 
+    cpu_write(st, st->A, 0x100+(st->S--));
+}
+CPU_INLINE void cpu_instr_php(cpu_state_t *st) {
+    cpu_tick(st); // 2 
+    cpu_write(st, cpu_get_p(st), 0x100+(st->S--));
+}
+CPU_INLINE void cpu_instr_pla(cpu_state_t *st) {
+    cpu_tick(st); // 2
+    st->S++; cpu_tick(st); // 3
+    st->A = cpu_read(st, 0x100+st->S);
     cpu_set_nz(st, st->A);
 }
-void cpu_instr_plp(cpu_state_t *st) {
-    st->tick(); // 2
-    st->S++; st->tick(); // 3
-    u8 p = st->bus_read(0x100+st->S);
-    st->P = *(cpu_sr_t*)(&p);
-    st->P.u = 1;
-    st->P.B = 1; // B, u always read as high
+CPU_INLINE void cpu_instr_plp(cpu_state_t *st) {
+    cpu_tick(st); // 2
+    st->S++; cpu_tick(st); // 3
+    u8 p = cpu_read(st, 0x100+st->S);
+    cpu_set_p(st, p | 0x30); // B, u always read as high
 }
 
-void cpu_instr_brk(cpu_state_t *st) {
-    st->PC++; st->tick(); // 2 (yes, this is a quirk of brk)
-    st->bus_write(lo((st->PC&0xFF00)>>8), 0x100 + (st->S--)); st->tick(); // 3
+CPU_INLINE void cpu_instr_brk(cpu_state_t *st) {
+    st->PC++; cpu_tick(st); // 2 (yes, this is a quirk of brk)
+    cpu_write(st, lo((st->PC&0xFF00)>>8), 0x100 + (st->S--)); cpu_tick(st); // 3
     // TODO If a hardware interrupt (NMI or IRQ) occurs before the fourth (flags
     // saving) cycle of BRK, the BRK instruction will be skipped, and
     // the processor will jump to the hardware interrupt vector. (64doc.txt)
-    st->bus_write(lo(st->PC), 0x100 + (st->S--)); st->tick(); // 4
-    cpu_sr_t sr = st->P;
-    st->bus_write(*(u8*)(&sr), 0x100 + (st->S--)); st->tick(); // 5
+    cpu_write(st, lo(st->PC), 0x100 + (st->S--)); cpu_tick(st); // 4
+    cpu_write(st, cpu_get_p(st), 0x100 + (st->S--)); cpu_tick(st); // 5
     st->PC = 0;
     st->P.I = 1;
-    st->PC |= lo(st->bus_read(0xFFFE)); st->tick(); // 6
-    st->PC |= hi(st->bus_read(0xFFFF)); // tick 7 in wrapper
+    st->PC |= lo(cpu_read(st, 0xFFFE)); cpu_tick(st); // 6
+    st->PC |= hi(cpu_read(st, 0xFFFF)); // tick 7 in wrapper
 }
 
-void cpu_instr_rti(cpu_state_t *st) {
-    st->tick(); // 2
-    st->S++; st->tick(); // 3
-    u8 p = st->bus_read(0x100+st->S++);
-    st->P = *(cpu_sr_t*)(&p); st->P.B = 1; st->P.u = 1; st->tick(); // 4
+CPU_INLINE void cpu_instr_rti(cpu_state_t *st) {
+    cpu_tick(st); // 2
+    st->S++; cpu_tick(st); // 3
+    u8 p = cpu_read(st, 0x100+st->S++);
+    cpu_set_p(st, p | 0x30); cpu_tick(st); // 4
     st->PC = 0;
-    st->PC |= lo(st->bus_read(0x100 + (st->S++))); st->tick(); // 5
-    st->PC |= ((u16)(st->bus_read(0x100 + st->S)) << 8); // tick 6 in wrapper
+    st->PC |= lo(cpu_read(st, 0x100 + (st->S++))); cpu_tick(st); // 5
+    st->PC |= ((u16)(cpu_read(st, 0x100 + st->S)) << 8); // tick 6 in wrapper
 }
 
-void cpu_instr_rts(cpu_state_t *st) {
-    st->tick(); // 2
-    st->S++; st->tick(); // 3
+CPU_INLINE void cpu_instr_rts(cpu_state_t *st) {
+    cpu_tick(st); // 2
+    st->S++; cpu_tick(st); // 3
     st->PC = 0;
-    st->PC |= lo(st->bus_read(0x100 + (st->S++))); st->tick(); // 4
-    st->PC |= ((u16)(st->bus_read(0x100 + st->S)) << 8); st->tick(); // 5
+    st->PC |= lo(cpu_read(st, 0x100 + (st->S++))); cpu_tick(st); // 4
+    st->PC |= ((u16)(cpu_read(st, 0x100 + st->S)) << 8); cpu_tick(st); // 5
     st->PC++; // tick 6 in wrapper
 }
 
 // branches
-bool cpu_instr_bcc(cpu_state_t *st) { return st->P.C == 0; }
-bool cpu_instr_bcs(cpu_state_t *st) { return st->P.C == 1; }
-bool cpu_instr_bne(cpu_state_t *st) { return st->P.Z == 0; }
-bool cpu_instr_beq(cpu_state_t *st) { return st->P.Z == 1; }
-bool cpu_instr_bpl(cpu_state_t *st) { return st->P.N == 0; }
-bool cpu_instr_bmi(cpu_state_t *st) { return st->P.N == 1; }
-bool cpu_instr_bvc(cpu_state_t *st) { return st->P.V == 0; }
-bool cpu_instr_bvs(cpu_state_t *st) { return st->P.V == 1; }
+CPU_INLINE bool cpu_instr_bcc(cpu_state_t *st) { return st->_c == 0; }
+CPU_INLINE bool cpu_instr_bcs(cpu_state_t *st) { return st->_c == 1; }
+CPU_INLINE bool cpu_instr_bne(cpu_state_t *st) { return st->_z != 0; }
+CPU_INLINE bool cpu_instr_beq(cpu_state_t *st) { return st->_z == 0; }
+CPU_INLINE bool cpu_instr_bpl(cpu_state_t *st) { return !(st->_n & 0x80); }
+CPU_INLINE bool cpu_instr_bmi(cpu_state_t *st) { return (st->_n & 0x80); }
+CPU_INLINE bool cpu_instr_bvc(cpu_state_t *st) { return st->_v == 0; }
+CPU_INLINE bool cpu_instr_bvs(cpu_state_t *st) { return st->_v == 1; }
+
+// operations by mnemonic. The addressing mode helpers below are always
+// inlined into a handler with a constant mnemonic, so these switches fold
+// down to the one operation the opcode uses
+CPU_INLINE void cpu_instr_read(cpu_state_t *st, cpu_mnemonic_t mn, u8 op) {
+    switch (mn) {
+        case CPU_LDA: cpu_instr_lda(st, op); break;
+        case CPU_LDX: cpu_instr_ldx(st, op); break;
+        case CPU_LDY: cpu_instr_ldy(st, op); break;
+        case CPU_ORA: cpu_instr_ora(st, op); break;
+        case CPU_EOR: cpu_instr_eor(st, op); break;
+        case CPU_AND: cpu_instr_and(st, op); break;
+        case CPU_CMP: cpu_instr_cmp(st, op); break;
+        case CPU_CPX: cpu_instr_cpx(st, op); break;
+        case CPU_CPY: cpu_instr_cpy(st, op); break;
+        case CPU_ADC: cpu_instr_adc(st, op); break;
+        case CPU_SBC: cpu_instr_sbc(st, op); break;
+        case CPU_BIT: cpu_instr_bit(st, op); break;
+        default: break;
+    }
+}
 
-// implied, accumulator instructions
+CPU_INLINE u8 cpu_instr_rmw(cpu_state_t *st, cpu_mnemonic_t mn, u8 op) {
+    switch (mn) {
+        case CPU_DEC: return cpu_instr_dec(st, op);
+        case CPU_INC: return cpu_instr_inc(st, op);
+        case CPU_ASL: return cpu_instr_asl(st, op);
+        case CPU_LSR: return cpu_instr_lsr(st, op);
+        case CPU_ROL: return cpu_instr_rol(st, op);
+        case CPU_ROR: return cpu_instr_ror(st, op);
+        default: return op;
+    }
+}
 
-void cpu_icl_all_imp(cpu_state_t *st, void (*instr)(cpu_state_t*)) {
-    instr(st); // 2, .., n-1
-    st->tick(); // n
+CPU_INLINE u8 cpu_instr_write(cpu_state_t *st, cpu_mnemonic_t mn) {
+    switch (mn) {
+        case CPU_STA: return cpu_instr_sta(st);
+        case CPU_STX: return cpu_instr_stx(st);
+        case CPU_STY: return cpu_instr_sty(st);
+        default: return 0;
+    }
 }
 
-void cpu_icl_all_acc(cpu_state_t *st, u8 (*instr)(cpu_state_t*, u8)) {
-    u8 res = instr(st, st->A); // 2, .., n-1
-    st->A = res; st->tick(); // n
+CPU_INLINE void cpu_instr_all(cpu_state_t *st, cpu_mnemonic_t mn) {
+    switch (mn) {
+        case CPU_CLC: cpu_instr_clc(st); break;
+        case CPU_CLD: cpu_instr_cld(st); break;
+        case CPU_CLI: cpu_instr_cli(st); break;
+        case CPU_CLV: cpu_instr_clv(st); break;
+        case CPU_SEC: cpu_instr_sec(st); break;
+        case CPU_SED: cpu_instr_sed(st); break;
+        case CPU_SEI: cpu_instr_sei(st); break;
+        case CPU_TAX: cpu_instr_tax(st); break;
+        case CPU_TAY: cpu_instr_tay(st); break;
+        case CPU_TSX: cpu_instr_tsx(st); break;
+        case CPU_TXA: cpu_instr_txa(st); break;
+        case CPU_TYA: cpu_instr_tya(st); break;
+        case CPU_TXS: cpu_instr_txs(st); break;
+        case CPU_DEX: cpu_instr_dex(st); break;
+        case CPU_DEY: cpu_instr_dey(st); break;
+        case CPU_INX: cpu_instr_inx(st); break;
+        case CPU_INY: cpu_instr_iny(st); break;
+        case CPU_NOP: cpu_instr_nop(st); break;
+        case CPU_PHA: cpu_instr_pha(st); break;
+        case CPU_PHP: cpu_instr_php(st); break;
+        case CPU_PLA: cpu_instr_pla(st); break;
+        case CPU_PLP: cpu_instr_plp(st); break;
+        case CPU_BRK: cpu_instr_brk(st); break;
+        case CPU_RTI: cpu_instr_rti(st); break;
+        case CPU_RTS: cpu_instr_rts(st); break;
+        default: break;
+    }
+}
+
+CPU_INLINE bool cpu_instr_branch(cpu_state_t *st, cpu_mnemonic_t mn) {
+    switch (mn) {
+        case CPU_BCC: return cpu_instr_bcc(st);
+        case CPU_BCS: return cpu_instr_bcs(st);
+        case CPU_BNE: return cpu_instr_bne(st);
+        case CPU_BEQ: return cpu_instr_beq(st);
+        case CPU_BPL: return cpu_instr_bpl(st);
+        case CPU_BMI: return cpu_instr_bmi(st);
+        case CPU_BVC: return cpu_instr_bvc(st);
+        case CPU_BVS: return cpu_instr_bvs(st);
+        default: return false;
+    }
 }
 
-void cpu_icl_all_imm(cpu_state_t *st, void (*instr)(cpu_state_t*, u8)) {
-    instr(st, st->bus_read(st->PC++)); st->tick(); // 2 .. n-1, n
+// Addressing mode helpers. The opcode and operand bytes were already read by
+// the decoder, so the operand fetch cycles only tick here
+
+// implied, accumulator and immediate instructions
+
+CPU_INLINE void cpu_icl_all_imp(cpu_state_t *st, u16 op, cpu_mnemonic_t mn) {
+    (void)op;
+    cpu_instr_all(st, mn); // 2, .., n-1
+    cpu_tick(st); // n
+}
+
+CPU_INLINE void cpu_icl_rmw_acc(cpu_state_t *st, u16 op, cpu_mnemonic_t mn) {
+    (void)op;
+    u8 res = cpu_instr_rmw(st, mn, st->A); // 2, .., n-1
+    st->A = res; cpu_tick(st); // n
+}
+
+CPU_INLINE void cpu_icl_read_imm(cpu_state_t *st, u16 op, cpu_mnemonic_t mn) {
+    cpu_instr_read(st, mn, op); cpu_tick(st); // 2 .. n-1, n
 }
 
 // Absolute addressing 
-void cpu_icl_read_abs(cpu_state_t *st, void (*instr)(cpu_state_t*, u8)) {
-    u16 addr = st->bus_read(st->PC++);  st->tick(); // 2
-    addr |= hi(st->bus_read(st->PC++)); st->tick(); // 3
-    instr(st, st->bus_read(addr));      st->tick(); // 4
+CPU_INLINE void cpu_icl_read_abs(cpu_state_t *st, u16 op, cpu_mnemonic_t mn) {
+    u16 addr = op;                      cpu_tick(st); // 2
+                                        cpu_tick(st); // 3
+    cpu_instr_read(st, mn, cpu_read(st, addr)); cpu_tick(st); // 4
 }
 
-void cpu_icl_rmw_abs(cpu_state_t *st, u8 (*instr)(cpu_state_t*, u8)) {
-    u16 addr = st->bus_read(st->PC++);  st->tick(); // 2
-    addr |= hi(st->bus_read(st->PC++)); st->tick(); // 3
-    u8 op = st->bus_read(addr);         st->tick(); // 4
-    u8 res = instr(st, op);    st->tick(); // 5
-    st->bus_write(res, addr);           st->tick(); // 6
+CPU_INLINE void cpu_icl_rmw_abs(cpu_state_t *st, u16 op, cpu_mnemonic_t mn) {
+    u16 addr = op;                      cpu_tick(st); // 2
+                                        cpu_tick(st); // 3
+    u8 val = cpu_read(st, addr);        cpu_tick(st); // 4
+    u8 res = cpu_instr_rmw(st, mn, val); cpu_tick(st); // 5
+    cpu_write(st, res, addr);           cpu_tick(st); // 6
 }
 
-void cpu_icl_write_abs(cpu_state_t *st, u8 (*instr)(cpu_state_t*)) {
-    u16 addr = st->bus_read(st->PC++);  st->tick(); // 2
-    addr |= hi(st->bus_read(st->PC++)); st->tick(); // 3
-    st->bus_write(instr(st), addr);     st->tick(); // 4
+CPU_INLINE void cpu_icl_write_abs(cpu_state_t *st, u16 op, cpu_mnemonic_t mn) {
+    u16 addr = op;                      cpu_tick(st); // 2
+                                        cpu_tick(st); // 3
+    cpu_write(st, cpu_instr_write(st, mn), addr); cpu_tick(st); // 4
 }
 
-void cpu_icl_jmp_abs(cpu_state_t *st) {
-    u16 addr = st->bus_read(st->PC++);                 st->tick(); // 2
-    addr |= hi(st->bus_read(st->PC++)); st->PC = addr; st->tick(); // 3
+CPU_INLINE void cpu_icl_jmp_abs(cpu_state_t *st, u16 op, cpu_mnemonic_t mn) {
+    (void)mn;
+                                        cpu_tick(st); // 2
+    st->PC = op;                        cpu_tick(st); // 3
 }
 
-void cpu_icl_jsr_abs(cpu_state_t *st) {
-    u16 addr = st->bus_read(st->PC++);                        st->tick(); // 2
-                                                     st->tick(); // 3 (internal operation?)
-    st->bus_write(lo((st->PC&0xFF00)>>8), 0x100 + (st->S--)); st->tick(); // 4
-    st->bus_write(lo(st->PC), 0x100 + (st->S--));             st->tick(); // 5
-    addr |= hi(st->bus_read(st->PC++)); st->PC = addr;        st->tick();
+CPU_INLINE void cpu_icl_jsr_abs(cpu_state_t *st, u16 op, cpu_mnemonic_t mn) {
+    (void)mn;
+    u16 ret = st->PC - 1; // pushes the address of the operand's high byte
+                                                     cpu_tick(st); // 2
+                                                     cpu_tick(st); // 3 (internal operation?)
+    cpu_write(st, lo((ret&0xFF00)>>8), 0x100 + (st->S--)); cpu_tick(st); // 4
+    cpu_write(st, lo(ret), 0x100 + (st->S--));             cpu_tick(st); // 5
+    st->PC = op;                                            cpu_tick(st);
 }
 
 // zero page addressing
-void cpu_icl_read_zpg(cpu_state_t *st, void (*instr)(cpu_state_t*, u8)) {
-    u8 zpa = st->bus_read(st->PC++);   st->tick(); // 2
-    instr(st, st->bus_read(zpa));      st->tick(); // 3
+CPU_INLINE void cpu_icl_read_zpg(cpu_state_t *st, u16 op, cpu_mnemonic_t mn) {
+    u8 zpa = op;                       cpu_tick(st); // 2
+    cpu_instr_read(st, mn, cpu_read(st, zpa)); cpu_tick(st); // 3
 }
 
-void cpu_icl_rmw_zpg(cpu_state_t *st, u8 (*instr)(cpu_state_t*, u8)) {
-    u8 zpa = st->bus_read(st->PC++);   st->tick(); // 2
-    u8 op = st->bus_read(zpa);         st->tick(); // 3
-    u8 res = instr(st, op);   st->tick(); // 4
-    st->bus_write(res, zpa);           st->tick(); // 5
+CPU_INLINE void cpu_icl_rmw_zpg(cpu_state_t *st, u16 op, cpu_mnemonic_t mn) {
+    u8 zpa = op;                       cpu_tick(st); // 2
+    u8 val = cpu_read(st, zpa);        cpu_tick(st); // 3
+    u8 res = cpu_instr_rmw(st, mn, val); cpu_tick(st); // 4
+    cpu_write(st, res, zpa);           cpu_tick(st); // 5
 }
 
-void cpu_icl_write_zpg(cpu_state_t *st, u8 (*instr)(cpu_state_t*)) {
-    u8 zpa = st->bus_read(st->PC++);   st->tick(); // 2
-    st->bus_write(instr(st), zpa);     st->tick(); // 3
+CPU_INLINE void cpu_icl_write_zpg(cpu_state_t *st, u16 op, cpu_mnemonic_t mn) {
+    u8 zpa = op;                       cpu_tick(st); // 2
+    cpu_write(st, cpu_instr_write(st, mn), zpa); cpu_tick(st); // 3
 }
 
 // zero page indexed addressing
-void cpu_icl_read_zpi(cpu_state_t *st, u8 idx, void (*instr)(cpu_state_t*, u8)) {
-    u8 zpa = st->bus_read(st->PC++);   st->tick(); // 2
-    u8 addr = lo(zpa+idx);    st->tick(); // 3
-    instr(st, st->bus_read(addr));     st->tick(); // 4
+CPU_INLINE void cpu_icl_read_zpi(cpu_state_t *st, u16 op, u8 idx, cpu_mnemonic_t mn) {
+    u8 zpa = op;                       cpu_tick(st); // 2
+    u8 addr = lo(zpa+idx);    cpu_tick(st); // 3
+    cpu_instr_read(st, mn, cpu_read(st, addr)); cpu_tick(st); // 4
 }
 
-void cpu_icl_rmw_zpi(cpu_state_t *st, u8 idx, u8 (*instr)(cpu_state_t*, u8)) {
-    u8 zpa = st->bus_read(st->PC++);   st->tick(); // 2
-    u8 addr = lo(zpa+idx);    st->tick(); // 3
-    u8 op = st->bus_read(addr);        st->tick(); // 4
-    u8 res = instr(st, op);   st->tick(); // 5
-    st->bus_write(res, addr);          st->tick(); // 6
+CPU_INLINE void cpu_icl_rmw_zpi(cpu_state_t *st, u16 op, u8 idx, cpu_mnemonic_t mn) {
+    u8 zpa = op;                       cpu_tick(st); // 2
+    u8 addr = lo(zpa+idx);    cpu_tick(st); // 3
+    u8 val = cpu_read(st, addr);       cpu_tick(st); // 4
+    u8 res = cpu_instr_rmw(st, mn, val); cpu_tick(st); // 5
+    cpu_write(st, res, addr);          cpu_tick(st); // 6
 }
 
-void cpu_icl_write_zpi(cpu_state_t *st, u8 idx, u8 (*instr)(cpu_state_t*)) {
-    u8 zpa = st->bus_read(st->PC++);   st->tick(); // 2
-    u8 addr = lo(zpa+idx);    st->tick(); // 3
-    st->bus_write(instr(st), addr);    st->tick(); // 4
+CPU_INLINE void cpu_icl_write_zpi(cpu_state_t *st, u16 op, u8 idx, cpu_mnemonic_t mn) {
+    u8 zpa = op;                       cpu_tick(st); // 2
+    u8 addr = lo(zpa+idx);    cpu_tick(st); // 3
+    cpu_write(st, cpu_instr_write(st, mn), addr); cpu_tick(st); // 4
 }
 
+CPU_INLINE void cpu_icl_read_zpx(cpu_state_t *st, u16 op, cpu_mnemonic_t mn) { cpu_icl_read_zpi(st, op, st->X, mn); }
+CPU_INLINE void cpu_icl_read_zpy(cpu_state_t *st, u16 op, cpu_mnemonic_t mn) { cpu_icl_read_zpi(st, op, st->Y, mn); }
+CPU_INLINE void cpu_icl_rmw_zpx(cpu_state_t *st, u16 op, cpu_mnemonic_t mn) { cpu_icl_rmw_zpi(st, op, st->X, mn); }
+CPU_INLINE void cpu_icl_write_zpx(cpu_state_t *st, u16 op, cpu_mnemonic_t mn) { cpu_icl_write_zpi(st, op, st->X, mn); }
+CPU_INLINE void cpu_icl_write_zpy(cpu_state_t *st, u16 op, cpu_mnemonic_t mn) { cpu_icl_write_zpi(st, op, st->Y, mn); }
+
 // absolute indexed addressing
-void cpu_icl_read_abi(cpu_state_t *st, u8 idx, void (*instr)(cpu_state_t*, u8)) {
-    u16 addr = st->bus_read(st->PC++);        st->tick(); // 2
-    addr |= hi(st->bus_read(st->PC++));       st->tick(); // 3
+CPU_INLINE void cpu_icl_read_abi(cpu_state_t *st, u16 op, u8 idx, cpu_mnemonic_t mn) {
+    u16 addr = op;                            cpu_tick(st); // 2
+                                              cpu_tick(st); // 3
     u16 newaddr = addr + idx;
-    if ((addr & 0xFF) + idx > 0xFF)  st->tick(); // fixup
-    instr(st, st->bus_read(newaddr));         st->tick(); // 4/5
+    if ((addr & 0xFF) + idx > 0xFF)  cpu_tick(st); // fixup
+    cpu_instr_read(st, mn, cpu_read(st, newaddr)); cpu_tick(st); // 4/5
 }
 
-void cpu_icl_rmw_abi(cpu_state_t *st, u8 idx, u8 (*instr)(cpu_state_t*, u8)) {
-    u16 addr = st->bus_read(st->PC++);        st->tick(); // 2
-    addr |= hi(st->bus_read(st->PC++));       st->tick(); // 3
-    u16 newaddr = addr + idx;        st->tick(); // 4
-    u8 op = st->bus_read(newaddr);            st->tick(); // 5
-    u8 res = instr(st, op);          st->tick(); // 6
-    st->bus_write(res, newaddr);              st->tick(); // 7
+CPU_INLINE void cpu_icl_rmw_abi(cpu_state_t *st, u16 op, u8 idx, cpu_mnemonic_t mn) {
+    u16 addr = op;                            cpu_tick(st); // 2
+                                              cpu_tick(st); // 3
+    u16 newaddr = addr + idx;        cpu_tick(st); // 4
+    u8 val = cpu_read(st, newaddr);           cpu_tick(st); // 5
+    u8 res = cpu_instr_rmw(st, mn, val); cpu_tick(st); // 6
+    cpu_write(st, res, newaddr);              cpu_tick(st); // 7
 }
 
-void cpu_icl_write_abi(cpu_state_t *st, u8 idx, u8 (*instr)(cpu_state_t*)) {
-    u16 addr = st->bus_read(st->PC++);        st->tick(); // 2
-    addr |= hi(st->bus_read(st->PC++));       st->tick(); // 3
-    u16 newaddr = addr + idx;        st->tick(); // 4
-    st->bus_write(instr(st), newaddr);        st->tick(); // 5
+CPU_INLINE void cpu_icl_write_abi(cpu_state_t *st, u16 op, u8 idx, cpu_mnemonic_t mn) {
+    u16 addr = op;                            cpu_tick(st); // 2
+                                              cpu_tick(st); // 3
+    u16 newaddr = addr + idx;        cpu_tick(st); // 4
+    cpu_write(st, cpu_instr_write(st, mn), newaddr); cpu_tick(st); // 5
 }
 
-void cpu_icl_branch(cpu_state_t *st, bool (*branch)(cpu_state_t*)) {
-    s8 op = st->bus_read(st->PC++);   st->tick(); // 2
-    if (!branch(st)) return;
-    st->tick(); // 3 (if branch is taken)
+CPU_INLINE void cpu_icl_read_abx(cpu_state_t *st, u16 op, cpu_mnemonic_t mn) { cpu_icl_read_abi(st, op, st->X, mn); }
+CPU_INLINE void cpu_icl_read_aby(cpu_state_t *st, u16 op, cpu_mnemonic_t mn) { cpu_icl_read_abi(st, op, st->Y, mn); }
+CPU_INLINE void cpu_icl_rmw_abx(cpu_state_t *st, u16 op, cpu_mnemonic_t mn) { cpu_icl_rmw_abi(st, op, st->X, mn); }
+CPU_INLINE void cpu_icl_write_abx(cpu_state_t *st, u16 op, cpu_mnemonic_t mn) { cpu_icl_write_abi(st, op, st->X, mn); }
+CPU_INLINE void cpu_icl_write_aby(cpu_state_t *st, u16 op, cpu_mnemonic_t mn) { cpu_icl_write_abi(st, op, st->Y, mn); }
+
+CPU_INLINE void cpu_icl_branch_rel(cpu_state_t *st, u16 op, cpu_mnemonic_t mn) {
+    s8 off = op;                      cpu_tick(st); // 2
+    if (!cpu_instr_branch(st, mn)) return;
+    cpu_tick(st); // 3 (if branch is taken)
     u16 old_pc = st->PC;
-    st->PC = old_pc + op;
-    if ((u16)((s16)(old_pc&0xFF) + op) > 0xFF) st->tick(); // 4 (if page changes)
+    st->PC = old_pc + off;
+    if ((u16)((s16)(old_pc&0xFF) + off) > 0xFF) cpu_tick(st); // 4 (if page changes)
 }
 
 // zero-page indirect preindexed [($nn, X)]
-void cpu_icl_read_zpx(cpu_state_t *st, void (*instr)(cpu_state_t*, u8)) {
-    u8 ptraddr = st->bus_read(st->PC++);        st->tick(); // 2
-    u8 ptr = lo(ptraddr + st->X);      st->tick(); // 3
-    u16 addr = st->bus_read(ptr);               st->tick(); // 4
-    addr |= hi(st->bus_read(lo(ptr+1)));        st->tick(); // 5
-    instr(st, st->bus_read(addr));              st->tick(); // 6
-}
-
-void cpu_icl_rmw_zpx(cpu_state_t *st, u8 (*instr)(cpu_state_t*, u8)) {
-    u8 ptraddr = st->bus_read(st->PC++);    st->tick(); // 2
-    u8 ptr = lo(ptraddr + st->X);  st->tick(); // 3
-    u16 addr = st->bus_read(ptr);           st->tick(); // 4
-    addr |= hi(st->bus_read(lo(ptr+1)));    st->tick(); // 5
-    u8 op = st->bus_read(addr);             st->tick(); // 6
-    u8 result = instr(st, op);     st->tick(); // 7
-    st->bus_write(result, addr);            st->tick(); // 8
+CPU_INLINE void cpu_icl_read_izx(cpu_state_t *st, u16 op, cpu_mnemonic_t mn) {
+    u8 ptraddr = op;                            cpu_tick(st); // 2
+    u8 ptr = lo(ptraddr + st->X);      cpu_tick(st); // 3
+    u16 addr = cpu_read(st, ptr);               cpu_tick(st); // 4
+    addr |= hi(cpu_read(st, lo(ptr+1)));        cpu_tick(st); // 5
+    cpu_instr_read(st, mn, cpu_read(st, addr)); cpu_tick(st); // 6
 }
 
-void cpu_icl_write_zpx(cpu_state_t *st, u8 (*instr)(cpu_state_t*)) {
-    u8 ptraddr = st->bus_read(st->PC++);    st->tick(); // 2
-    u8 ptr = lo(ptraddr + st->X);  st->tick(); // 3
-    u16 addr = st->bus_read(ptr);           st->tick(); // 4
-    addr |= hi(st->bus_read(lo(ptr+1)));    st->tick(); // 5
-    st->bus_write(instr(st), addr);         st->tick(); // 6
+CPU_INLINE void cpu_icl_write_izx(cpu_state_t *st, u16 op, cpu_mnemonic_t mn) {
+    u8 ptraddr = op;                        cpu_tick(st); // 2
+    u8 ptr = lo(ptraddr + st->X);  cpu_tick(st); // 3
+    u16 addr = cpu_read(st, ptr);           cpu_tick(st); // 4
+    addr |= hi(cpu_read(st, lo(ptr+1)));    cpu_tick(st); // 5
+    cpu_write(st, cpu_instr_write(st, mn), addr); cpu_tick(st); // 6
 }
 
 // zero-page preindexed indirect [($nn), Y]
-void cpu_icl_read_zpy(cpu_state_t *st, void (*instr)(cpu_state_t*, u8)) {
-    u8 ptr = st->bus_read(st->PC++);           st->tick(); // 2
-    u16 addr = st->bus_read(ptr);              st->tick(); // 3
-    addr |= hi(st->bus_read(lo(ptr+1)));
-    u16 newaddr = addr + st->Y;       st->tick(); // 4
-    if ((addr & 0xFF) + st->Y > 0xFF) st->tick(); // fixup
-    instr(st, st->bus_read(newaddr));          st->tick(); // 5/6
+CPU_INLINE void cpu_icl_read_izy(cpu_state_t *st, u16 op, cpu_mnemonic_t mn) {
+    u8 ptr = op;                               cpu_tick(st); // 2
+    u16 addr = cpu_read(st, ptr);              cpu_tick(st); // 3
+    addr |= hi(cpu_read(st, lo(ptr+1)));
+    u16 newaddr = addr + st->Y;       cpu_tick(st); // 4
+    if ((addr & 0xFF) + st->Y > 0xFF) cpu_tick(st); // fixup
+    cpu_instr_read(st, mn, cpu_read(st, newaddr)); cpu_tick(st); // 5/6
 }
 
-void cpu_icl_rmw_zpy(cpu_state_t *st, u8 (*instr)(cpu_state_t*, u8)) {
-    u8 ptr = st->bus_read(st->PC++);       st->tick(); // 2
-    u16 addr = st->bus_read(ptr);          st->tick(); // 3
-    addr |= hi(st->bus_read(lo(ptr+1)));   st->tick(); // 4
-    u16 newaddr = addr + st->Y;   st->tick(); // 5
-    u8 op = st->bus_read(newaddr);         st->tick(); // 6
-    u8 result = instr(st, op);    st->tick(); // 7
-    st->bus_write(result, newaddr);        st->tick(); // 8
-}
-
-void cpu_icl_write_zpy(cpu_state_t *st, u8 (*instr)(cpu_state_t*)) {
-    u8 ptr = st->bus_read(st->PC++);       st->tick(); // 2
-    u16 addr = st->bus_read(ptr);          st->tick(); // 3
-    addr |= hi(st->bus_read(lo(ptr+1)));   st->tick(); // 4
-    u16 newaddr = addr + st->Y;   st->tick(); // 5
-    st->bus_write(instr(st), newaddr);     st->tick(); // 6
+CPU_INLINE void cpu_icl_write_izy(cpu_state_t *st, u16 op, cpu_mnemonic_t mn) {
+    u8 ptr = op;                           cpu_tick(st); // 2
+    u16 addr = cpu_read(st, ptr);          cpu_tick(st); // 3
+    addr |= hi(cpu_read(st, lo(ptr+1)));   cpu_tick(st); // 4
+    u16 newaddr = addr + st->Y;   cpu_tick(st); // 5
+    cpu_write(st, cpu_instr_write(st, mn), newaddr); cpu_tick(st); // 6
 }
 
 // absolute indirect addressing 
-void cpu_icl_jmp_ind(cpu_state_t *st) {
-    u16 ptr = st->bus_read(st->PC++);        st->tick(); // 2
-    ptr |= hi(st->bus_read(st->PC++));       st->tick(); // 3
-    u8 latch = st->bus_read(ptr);            st->tick(); // 4
-    st->PC = hi(st->bus_read((ptr & 0xFF00) | lo(ptr+1))) | latch; st->tick(); // 5
+CPU_INLINE void cpu_icl_jmp_ind(cpu_state_t *st, u16 op, cpu_mnemonic_t mn) {
+    (void)mn;
+    u16 ptr = op;                            cpu_tick(st); // 2
+                                             cpu_tick(st); // 3
+    u8 latch = cpu_read(st, ptr);            cpu_tick(st); // 4
+    st->PC = hi(cpu_read(st, (ptr & 0xFF00) | lo(ptr+1))) | latch; cpu_tick(st); // 5
+}
+
+// one concrete handler per opcode, e.g. cpu_op_LDA_abs
+#define CPU_OP_HANDLER(opc, mn, mode, kind, cyc) \
+    CPU_INLINE void cpu_op_##mn##_##mode(cpu_state_t *st, u16 op) { cpu_icl_##kind##_##mode(st, op, CPU_##mn); }
+CPU_OPCODE_TABLE(CPU_OP_HANDLER)
+#undef CPU_OP_HANDLER
+
+const char *cpu_mnemonic_names[] = {
+#define CPU_MNEMONIC_NAME(mn) #mn,
+    CPU_MNEMONIC_TABLE(CPU_MNEMONIC_NAME)
+#undef CPU_MNEMONIC_NAME
+};
+
+enum {
+#define CPU_MODE_LENGTH(mode, len, fmt) CPU_LEN_##mode = len,
+    CPU_MODE_TABLE(CPU_MODE_LENGTH)
+#undef CPU_MODE_LENGTH
+};
+
+static const char *cpu_mode_formats[] = {
+#define CPU_MODE_FORMAT(mode, len, fmt) fmt,
+    CPU_MODE_TABLE(CPU_MODE_FORMAT)
+#undef CPU_MODE_FORMAT
+};
+
+const cpu_opcode_t cpu_opcodes[256] = {
+#define CPU_OPCODE_INFO(opc, mn, mode, kind, cyc) \
+    [opc] = { CPU_##mn, CPU_MODE_##mode, CPU_KIND_##kind, CPU_LEN_##mode, cyc },
+    CPU_OPCODE_TABLE(CPU_OPCODE_INFO)
+#undef CPU_OPCODE_INFO
+};
+
+int cpu_disasm(u16 pc, const u8 bytes[3], char buf[32]) {
+    cpu_opcode_t info = cpu_opcodes[bytes[0]];
+    if (info.mnemonic == CPU_ILL) {
+        snprintf(buf, 32, "%04hX  .db $%02hhX", pc, bytes[0]);
+        return 1;
+    }
+    u16 operand = (info.length == 3) ? (bytes[1] | hi(bytes[2])) : bytes[1];
+    if (info.mode == CPU_MODE_rel) operand = pc + 2 + (s8)bytes[1];
+    int n = snprintf(buf, 32, "%04hX  %s", pc, cpu_mnemonic_names[info.mnemonic]);
+    snprintf(buf+n, 32-n, cpu_mode_formats[info.mode], operand);
+    return info.length;
 }
 
-
 void cpu_reset(cpu_state_t *st) {
-    st->PC |= hi(st->bus_read(0xFFFC));
-    st->PC |= lo(st->bus_read(0xFFFD));
+    st->PC |= hi(cpu_read(st, 0xFFFC));
+    st->PC |= lo(cpu_read(st, 0xFFFD));
     st->P.I = 1;
 }
 
 void cpu_interrupt(cpu_state_t *st, u16 pc_addr) {
-    st->tick(); // 1
-    st->tick(); // 2
-    st->bus_write(lo((st->PC&0xFF00)>>8), 0x100 + (st->S--)); st->tick(); // 3
-    st->bus_write(lo(st->PC), 0x100 + (st->S--)); st->tick(); // 4
-    cpu_sr_t sr = st->P;
-    st->bus_write(*(u8*)(&sr), 0x100 + (st->S--)); st->tick(); // 5
+    cpu_tick(st); // 1
+    cpu_tick(st); // 2
+    cpu_write(st, lo((st->PC&0xFF00)>>8), 0x100 + (st->S--)); cpu_tick(st); // 3
+    cpu_write(st, lo(st->PC), 0x100 + (st->S--)); cpu_tick(st); // 4
+    cpu_write(st, cpu_get_p(st), 0x100 + (st->S--)); cpu_tick(st); // 5
     st->PC = 0;
     st->P.I = 1;
-    st->PC |= lo(st->bus_read(pc_addr)); st->tick(); // 6
-    st->PC |= hi(st->bus_read(pc_addr+1)); st->tick(); // 7
+    st->PC |= lo(cpu_read(st, pc_addr)); cpu_tick(st); // 6
+    st->PC |= hi(cpu_read(st, pc_addr+1)); cpu_tick(st); // 7
+}
+
+void cpu_decode_cache_init(cpu_state_t *st, u16 base, u32 size) {
+    cpu_decode_cache_t *dc = malloc(sizeof(cpu_decode_cache_t));
+    cpu_decoded_t *entries = calloc(size, sizeof(cpu_decoded_t));
+    if (dc == NULL || entries == NULL) {
+        log_fatal("Could not allocate the decode cache");
+        exit(-1);
+    }
+    *dc = (cpu_decode_cache_t){ .base = base, .size = size, .entries = entries };
+    st->decode_cache = dc;
+}
+
+void cpu_decode_cache_flush(cpu_state_t *st) {
+    cpu_decode_cache_t *dc = st->decode_cache;
+    if (dc == NULL) return;
+    memset(dc->entries, 0, dc->size * sizeof(cpu_decoded_t));
+    if (st->jit != NULL) jit_flush(st->jit);
+}
+
+void cpu_decode_cache_free(cpu_state_t *st) {
+    cpu_decode_cache_t *dc = st->decode_cache;
+    if (dc == NULL) return;
+    free(dc->entries);
+    free(dc);
+    st->decode_cache = NULL;
+}
+
+static void cpu_decode(cpu_state_t *st, u16 pc, cpu_decoded_t *d, const void *const *dispatch) {
+    cpu_opcode_t info;
+    d->opcode = cpu_read(st, pc);
+    info = cpu_opcodes[d->opcode];
+    d->length = info.length ? info.length : 1;
+    d->operand = 0;
+    if (d->length >= 2) d->operand = cpu_read(st, pc+1);
+    if (d->length == 3) d->operand |= hi(cpu_read(st, pc+2));
+    d->handler = dispatch ? dispatch[d->opcode] : NULL;
+    d->block_len = 1;
+}
+
+static bool cpu_ends_block(u8 opc) {
+    cpu_opcode_t info = cpu_opcodes[opc];
+    switch (info.mnemonic) {
+        case CPU_ILL: case CPU_BRK: case CPU_RTI: case CPU_RTS: return true;
+        default: break;
+    }
+    return info.kind == CPU_KIND_branch || info.kind == CPU_KIND_jmp || 
+           info.kind == CPU_KIND_jsr;
+}
+
+#define CPU_IDLE_LOOP_LEN 5
+
+// Idle loops only read memory and branch back to their start, like waiting
+// for a vblank flag. Once what they read has settled they go around the same
+// way until something else changes it. Returns the cycles of one round from
+// head to the branch back at tail, 0 if this isn't such a loop
+static u8 cpu_idle_loop_cycles(const cpu_decode_cache_t *dc, u16 head, u16 tail) {
+    u32 addr = head;
+    u8 cycles = 0;
+    for (int i = 0; i < CPU_IDLE_LOOP_LEN && addr <= tail; i++) {
+        const cpu_decoded_t *d = &dc->entries[addr - dc->base];
+        cpu_opcode_t info = cpu_opcodes[d->opcode];
+        if (!d->block_len) return 0;
+        cycles += info.cycles;
+        if (addr == tail) {
+            if (info.kind == CPU_KIND_jmp && info.mode == CPU_MODE_abs) return cycles;
+            if (info.kind != CPU_KIND_branch) return 0;
+            // taken, and one more if it lands on another page
+            return cycles + 1 + (((u16)(tail + d->length) ^ head) > 0xFF);
+        }
+        switch (info.mnemonic) {
+            case CPU_LDA: case CPU_LDX: case CPU_LDY: case CPU_BIT: case CPU_AND:
+            case CPU_ORA: case CPU_CMP: case CPU_CPX: case CPU_CPY: case CPU_NOP:
+                break;
+            default: return 0;
+        }
+        switch (info.mode) {
+            case CPU_MODE_imp: case CPU_MODE_imm: case CPU_MODE_zpg: case CPU_MODE_abs:
+                break;
+            default: return 0;
+        }
+        addr += d->length;
+    }
+    return 0;
+}
+
+// Decodes the basic block starting at pc into the cache, up to the next
+// control flow instruction or an address that was already decoded. Only
+// instructions that lie entirely inside the cache are decoded
+static void cpu_decode_block(cpu_state_t *st, u16 pc, const void *const *dispatch) {
+    cpu_decode_cache_t *dc = st->decode_cache;
+    u32 end = dc->base + dc->size;
+    u32 addr = pc, last = pc;
+    int n = 0;
+    while (n < 255 && addr < end && !dc->entries[addr - dc->base].block_len) {
+        cpu_decoded_t d;
+        cpu_decode(st, addr, &d, dispatch);
+        if (addr + d.length > end) break;
+        dc->entries[addr - dc->base] = d;
+        last = addr;
+        addr += d.length;
+        n++;
+        if (cpu_ends_block(d.opcode)) break;
+    }
+    // number the block backwards so every entry knows how much of it is left
+    for (addr = pc; n > 0; n--) {
+        cpu_decoded_t *d = &dc->entries[addr - dc->base];
+        d->block_len = n;
+        addr += d->length;
+    }
+    if (addr == pc) return;
+
+    // a jump back into the block closes a loop, see if it's an idle one
+    const cpu_decoded_t *d = &dc->entries[last - dc->base];
+    cpu_opcode_t info = cpu_opcodes[d->opcode];
+    u32 target;
+    if (info.kind == CPU_KIND_branch) target = (u16)(last + d->length + (s8)d->operand);
+    else if (info.kind == CPU_KIND_jmp && info.mode == CPU_MODE_abs) target = d->operand;
+    else return;
+    if (target < pc || target > last) return;
+    dc->entries[target - dc->base].idle_cycles = cpu_idle_loop_cycles(dc, target, last);
+}
+
+// An idle loop is skipped once it went around twice in a row in exactly its
+// own cycles, so side effects of its reads (like clearing the vblank flag)
+// are done. Skips whole rounds up to where the system says the addresses it
+// reads may change
+static bool cpu_idle_skip(cpu_state_t *st) {
+    cpu_decode_cache_t *dc = st->decode_cache;
+    if (st->idle_until == NULL || dc == NULL) return false;
+    if (st->PC < dc->base || (u32)(st->PC - dc->base) >= dc->size) return false;
+    u8 round = dc->entries[st->PC - dc->base].idle_cycles;
+    if (!round) return false;
+
+    if (st->idle_pc == st->PC && st->cycles - st->idle_cycle == round) {
+        if (st->idle_count < 2) st->idle_count++;
+    } else st->idle_count = 0;
+    st->idle_pc = st->PC;
+    st->idle_cycle = st->cycles;
+    if (st->idle_count < 2) return false;
+
+    u16 addrs[CPU_IDLE_LOOP_LEN];
+    int n = 0;
+    for (u32 addr = st->PC; ; ) {
+        const cpu_decoded_t *d = &dc->entries[addr - dc->base];
+        cpu_opcode_t info = cpu_opcodes[d->opcode];
+        if (info.kind == CPU_KIND_branch || info.kind == CPU_KIND_jmp) break;
+        if (info.mode == CPU_MODE_zpg || info.mode == CPU_MODE_abs) addrs[n++] = d->operand;
+        addr += d->length;
+    }
+    u64 until = st->idle_until(addrs, n);
+    if (until <= st->cycles) return false;
+    u64 skip = (until - st->cycles) / round * round;
+    if (skip == 0) return false;
+    st->cycles += skip;
+    st->idle_cycles_skipped += skip;
+    st->idle_cycle = st->cycles;
+    return true;
+}
+
+static const cpu_decoded_t *cpu_fetch(cpu_state_t *st, cpu_decoded_t *scratch, 
+                                      const void *const *dispatch) {
+    cpu_decode_cache_t *dc = st->decode_cache;
+    if (dc != NULL && st->PC >= dc->base && (u32)(st->PC - dc->base) < dc->size) {
+        cpu_decoded_t *d = &dc->entries[st->PC - dc->base];
+        if (!d->block_len) cpu_decode_block(st, st->PC, dispatch);
+        if (d->block_len) return d;
+    }
+    cpu_decode(st, st->PC, scratch, dispatch);
+    return scratch;
 }
 
 int cpu_exec(cpu_state_t *st) {
@@ -390,177 +716,50 @@ int cpu_exec(cpu_state_t *st) {
         return 3;
     }
 
-    u8 opc = st->bus_read(st->PC++); st->tick();
-    switch (opc) {
-        case 0xAA: cpu_icl_all_imp(st, &cpu_instr_tax); break;
-        case 0xA8: cpu_icl_all_imp(st, &cpu_instr_tay); break;
-        case 0xBA: cpu_icl_all_imp(st, &cpu_instr_tsx); break;
-        case 0x8A: cpu_icl_all_imp(st, &cpu_instr_txa); break;
-        case 0x9A: cpu_icl_all_imp(st, &cpu_instr_txs); break;
-        case 0x98: cpu_icl_all_imp(st, &cpu_instr_tya); break;
-        case 0x48: cpu_icl_all_imp(st, &cpu_instr_pha); break;
-        case 0x08: cpu_icl_all_imp(st, &cpu_instr_php); break;
-        case 0x68: cpu_icl_all_imp(st, &cpu_instr_pla); break;
-        case 0x28: cpu_icl_all_imp(st, &cpu_instr_plp); break;
-        case 0xCA: cpu_icl_all_imp(st, &cpu_instr_dex); break;
-        case 0x88: cpu_icl_all_imp(st, &cpu_instr_dey); break;
-        case 0xE8: cpu_icl_all_imp(st, &cpu_instr_inx); break;
-        case 0xC8: cpu_icl_all_imp(st, &cpu_instr_iny); break;
-        case 0x00: cpu_icl_all_imp(st, &cpu_instr_brk); break;
-        case 0x40: cpu_icl_all_imp(st, &cpu_instr_rti); break;
-        case 0x60: cpu_icl_all_imp(st, &cpu_instr_rts); break;
-        case 0x18: cpu_icl_all_imp(st, &cpu_instr_clc); break;
-        case 0xD8: cpu_icl_all_imp(st, &cpu_instr_cld); break;
-        case 0x58: cpu_icl_all_imp(st, &cpu_instr_cli); break;
-        case 0xB8: cpu_icl_all_imp(st, &cpu_instr_clv); break;
-        case 0x38: cpu_icl_all_imp(st, &cpu_instr_sec); break;
-        case 0xF8: cpu_icl_all_imp(st, &cpu_instr_sed); break;
-        case 0x78: cpu_icl_all_imp(st, &cpu_instr_sei); break;
-        case 0xEA: cpu_icl_all_imp(st, &cpu_instr_nop); break;
-
-        case 0x0A: cpu_icl_all_acc(st, &cpu_instr_asl); break;
-        case 0x4A: cpu_icl_all_acc(st, &cpu_instr_lsr); break;
-        case 0x2A: cpu_icl_all_acc(st, &cpu_instr_rol); break;
-        case 0x6A: cpu_icl_all_acc(st, &cpu_instr_ror); break;
-
-        case 0xA9: cpu_icl_all_imm(st, &cpu_instr_lda); break;
-        case 0xA2: cpu_icl_all_imm(st, &cpu_instr_ldx); break;
-        case 0xA0: cpu_icl_all_imm(st, &cpu_instr_ldy); break;
-        case 0x29: cpu_icl_all_imm(st, &cpu_instr_and); break;
-        case 0x49: cpu_icl_all_imm(st, &cpu_instr_eor); break;
-        case 0x09: cpu_icl_all_imm(st, &cpu_instr_ora); break;
-        case 0x69: cpu_icl_all_imm(st, &cpu_instr_adc); break;
-        case 0xC9: cpu_icl_all_imm(st, &cpu_instr_cmp); break;
-        case 0xE0: cpu_icl_all_imm(st, &cpu_instr_cpx); break;
-        case 0xC0: cpu_icl_all_imm(st, &cpu_instr_cpy); break;
-        case 0xE9: cpu_icl_all_imm(st, &cpu_instr_sbc); break;
-
-        case 0xAD: cpu_icl_read_abs(st, &cpu_instr_lda); break;
-        case 0xAE: cpu_icl_read_abs(st, &cpu_instr_ldx); break;
-        case 0xAC: cpu_icl_read_abs(st, &cpu_instr_ldy); break;
-        case 0x4D: cpu_icl_read_abs(st, &cpu_instr_eor); break;
-        case 0x2D: cpu_icl_read_abs(st, &cpu_instr_and); break;
-        case 0x0D: cpu_icl_read_abs(st, &cpu_instr_ora); break;
-        case 0x6D: cpu_icl_read_abs(st, &cpu_instr_adc); break;
-        case 0xED: cpu_icl_read_abs(st, &cpu_instr_sbc); break;
-        case 0xCD: cpu_icl_read_abs(st, &cpu_instr_cmp); break;
-        case 0xEC: cpu_icl_read_abs(st, &cpu_instr_cpx); break;
-        case 0xCC: cpu_icl_read_abs(st, &cpu_instr_cpy); break;
-        case 0x2C: cpu_icl_read_abs(st, &cpu_instr_bit); break;
-
-        case 0x0E: cpu_icl_rmw_abs(st, &cpu_instr_asl); break;
-        case 0x4E: cpu_icl_rmw_abs(st, &cpu_instr_lsr); break;
-        case 0x2E: cpu_icl_rmw_abs(st, &cpu_instr_rol); break;
-        case 0x6E: cpu_icl_rmw_abs(st, &cpu_instr_ror); break;
-        case 0xEE: cpu_icl_rmw_abs(st, &cpu_instr_inc); break;
-        case 0xCE: cpu_icl_rmw_abs(st, &cpu_instr_dec); break;
-
-        case 0x8D: cpu_icl_write_abs(st, &cpu_instr_sta); break;
-        case 0x8E: cpu_icl_write_abs(st, &cpu_instr_stx); break;
-        case 0x8C: cpu_icl_write_abs(st, &cpu_instr_sty); break;
-
-        case 0x4C: cpu_icl_jmp_abs(st); break;
-        case 0x20: cpu_icl_jsr_abs(st); break;
-
-        case 0xBD: cpu_icl_read_abi(st, st->X, &cpu_instr_lda); break;
-        case 0xBC: cpu_icl_read_abi(st, st->X, &cpu_instr_ldy); break;
-        case 0x3D: cpu_icl_read_abi(st, st->X, &cpu_instr_and); break;
-        case 0x5D: cpu_icl_read_abi(st, st->X, &cpu_instr_eor); break;
-        case 0x1D: cpu_icl_read_abi(st, st->X, &cpu_instr_ora); break;
-        case 0x7D: cpu_icl_read_abi(st, st->X, &cpu_instr_adc); break;
-        case 0xDD: cpu_icl_read_abi(st, st->X, &cpu_instr_cmp); break;
-        case 0xFD: cpu_icl_read_abi(st, st->X, &cpu_instr_sbc); break;
-        case 0x1E: cpu_icl_rmw_abi(st, st->X, &cpu_instr_asl); break;
-        case 0x5E: cpu_icl_rmw_abi(st, st->X, &cpu_instr_lsr); break;
-        case 0x3E: cpu_icl_rmw_abi(st, st->X, &cpu_instr_rol); break;
-        case 0x7E: cpu_icl_rmw_abi(st, st->X, &cpu_instr_ror); break;
-        case 0xDE: cpu_icl_rmw_abi(st, st->X, &cpu_instr_dec); break;
-        case 0xFE: cpu_icl_rmw_abi(st, st->X, &cpu_instr_inc); break;
-        case 0x9D: cpu_icl_write_abi(st, st->X, &cpu_instr_sta); break;
-
-        case 0xB9: cpu_icl_read_abi(st, st->Y, &cpu_instr_lda); break;
-        case 0xBE: cpu_icl_read_abi(st, st->Y, &cpu_instr_ldx); break;
-        case 0x39: cpu_icl_read_abi(st, st->Y, &cpu_instr_and); break;
-        case 0x59: cpu_icl_read_abi(st, st->Y, &cpu_instr_eor); break;
-        case 0x19: cpu_icl_read_abi(st, st->Y, &cpu_instr_ora); break;
-        case 0x79: cpu_icl_read_abi(st, st->Y, &cpu_instr_adc); break;
-        case 0xD9: cpu_icl_read_abi(st, st->Y, &cpu_instr_cmp); break;
-        case 0xF9: cpu_icl_read_abi(st, st->Y, &cpu_instr_sbc); break;
-        case 0x99: cpu_icl_write_abi(st, st->Y, &cpu_instr_sta); break;
-
-        case 0x6C: cpu_icl_jmp_ind(st); break;
-
-        case 0xA5: cpu_icl_read_zpg(st, &cpu_instr_lda); break;
-        case 0xA6: cpu_icl_read_zpg(st, &cpu_instr_ldx); break;
-        case 0xA4: cpu_icl_read_zpg(st, &cpu_instr_ldy); break;
-        case 0x25: cpu_icl_read_zpg(st, &cpu_instr_and); break;
-        case 0x24: cpu_icl_read_zpg(st, &cpu_instr_bit); break;
-        case 0x45: cpu_icl_read_zpg(st, &cpu_instr_eor); break;
-        case 0x05: cpu_icl_read_zpg(st, &cpu_instr_ora); break;
-        case 0x65: cpu_icl_read_zpg(st, &cpu_instr_adc); break;
-        case 0xC5: cpu_icl_read_zpg(st, &cpu_instr_cmp); break;
-        case 0xE4: cpu_icl_read_zpg(st, &cpu_instr_cpx); break;
-        case 0xC4: cpu_icl_read_zpg(st, &cpu_instr_cpy); break;
-        case 0xE5: cpu_icl_read_zpg(st, &cpu_instr_sbc); break;
-        case 0xC6: cpu_icl_rmw_zpg(st, &cpu_instr_dec); break;
-        case 0xE6: cpu_icl_rmw_zpg(st, &cpu_instr_inc); break;
-        case 0x06: cpu_icl_rmw_zpg(st, &cpu_instr_asl); break;
-        case 0x46: cpu_icl_rmw_zpg(st, &cpu_instr_lsr); break;
-        case 0x26: cpu_icl_rmw_zpg(st, &cpu_instr_rol); break;
-        case 0x66: cpu_icl_rmw_zpg(st, &cpu_instr_ror); break;
-        case 0x85: cpu_icl_write_zpg(st, &cpu_instr_sta); break;
-        case 0x86: cpu_icl_write_zpg(st, &cpu_instr_stx); break;
-        case 0x84: cpu_icl_write_zpg(st, &cpu_instr_sty); break;
-
-        case 0xB5: cpu_icl_read_zpi(st, st->X, &cpu_instr_lda); break;
-        case 0xB4: cpu_icl_read_zpi(st, st->X, &cpu_instr_ldy); break;
-        case 0x35: cpu_icl_read_zpi(st, st->X, &cpu_instr_and); break;
-        case 0x55: cpu_icl_read_zpi(st, st->X, &cpu_instr_eor); break;
-        case 0x15: cpu_icl_read_zpi(st, st->X, &cpu_instr_ora); break;
-        case 0x75: cpu_icl_read_zpi(st, st->X, &cpu_instr_adc); break;
-        case 0xD5: cpu_icl_read_zpi(st, st->X, &cpu_instr_cmp); break;
-        case 0xF5: cpu_icl_read_zpi(st, st->X, &cpu_instr_sbc); break;
-        case 0x16: cpu_icl_rmw_zpi(st, st->X, &cpu_instr_asl); break;
-        case 0x56: cpu_icl_rmw_zpi(st, st->X, &cpu_instr_lsr); break;
-        case 0x36: cpu_icl_rmw_zpi(st, st->X, &cpu_instr_rol); break;
-        case 0x76: cpu_icl_rmw_zpi(st, st->X, &cpu_instr_ror); break;
-        case 0xD6: cpu_icl_rmw_zpi(st, st->X, &cpu_instr_dec); break;
-        case 0xF6: cpu_icl_rmw_zpi(st, st->X, &cpu_instr_inc); break;
-        case 0x95: cpu_icl_write_zpi(st, st->X, &cpu_instr_sta); break;
-        case 0x94: cpu_icl_write_zpi(st, st->X, &cpu_instr_sty); break;
-
-        case 0xB6: cpu_icl_read_zpi(st, st->Y, &cpu_instr_ldx); break;
-        case 0x96: cpu_icl_write_zpi(st, st->Y, &cpu_instr_stx); break;
-        
-        case 0xA1: cpu_icl_read_zpx(st, &cpu_instr_lda); break;
-        case 0x21: cpu_icl_read_zpx(st, &cpu_instr_and); break;
-        case 0x41: cpu_icl_read_zpx(st, &cpu_instr_eor); break;
-        case 0x01: cpu_icl_read_zpx(st, &cpu_instr_ora); break;
-        case 0x61: cpu_icl_read_zpx(st, &cpu_instr_adc); break;
-        case 0xC1: cpu_icl_read_zpx(st, &cpu_instr_cmp); break;
-        case 0xE1: cpu_icl_read_zpx(st, &cpu_instr_sbc); break;
-        case 0x81: cpu_icl_write_zpx(st, &cpu_instr_sta); break;
-
-        case 0xB1: cpu_icl_read_zpy(st, &cpu_instr_lda); break;
-        case 0x31: cpu_icl_read_zpy(st, &cpu_instr_and); break;
-        case 0x51: cpu_icl_read_zpy(st, &cpu_instr_eor); break;
-        case 0x11: cpu_icl_read_zpy(st, &cpu_instr_ora); break;
-        case 0x71: cpu_icl_read_zpy(st, &cpu_instr_adc); break;
-        case 0xD1: cpu_icl_read_zpy(st, &cpu_instr_cmp); break;
-        case 0xF1: cpu_icl_read_zpy(st, &cpu_instr_sbc); break;
-        case 0x91: cpu_icl_write_zpy(st, &cpu_instr_sta); break;
-
-        case 0x90: cpu_icl_branch(st, &cpu_instr_bcc); break;
-        case 0xB0: cpu_icl_branch(st, &cpu_instr_bcs); break;
-        case 0xF0: cpu_icl_branch(st, &cpu_instr_beq); break;
-        case 0x30: cpu_icl_branch(st, &cpu_instr_bmi); break;
-        case 0xD0: cpu_icl_branch(st, &cpu_instr_bne); break;
-        case 0x10: cpu_icl_branch(st, &cpu_instr_bpl); break;
-        case 0x50: cpu_icl_branch(st, &cpu_instr_bvc); break;
-        case 0x70: cpu_icl_branch(st, &cpu_instr_bvs); break;
+    if (cpu_idle_skip(st)) return 0;
+
+    if (st->jit != NULL) {
+        // a translated block hands back its cycles to count all at once
+        int cycles = jit_exec(st);
+        if (cycles > 0) {
+            st->cycles += cycles;
+            return 0;
+        }
+    }
 
+    cpu_decoded_t scratch;
+    const cpu_decoded_t *d;
+#ifdef CPU_COMPUTED_GOTO
+    // each opcode gets its own label with its handler inlined, and we jump
+    // straight to it instead of going through the switch
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Woverride-init"
+    static const void *const dispatch[256] = {
+        [0 ... 255] = &&op_illegal,
+#define CPU_OP_TARGET(opc, mn, mode, kind, cyc) [opc] = &&op_##opc,
+        CPU_OPCODE_TABLE(CPU_OP_TARGET)
+#undef CPU_OP_TARGET
+    };
+#pragma GCC diagnostic pop
+
+    d = cpu_fetch(st, &scratch, dispatch);
+    st->PC += d->length; cpu_tick(st);
+    goto *d->handler;
+#define CPU_OP_LABEL(opc, mn, mode, kind, cyc) op_##opc: cpu_op_##mn##_##mode(st, d->operand); return 0;
+    CPU_OPCODE_TABLE(CPU_OP_LABEL)
+#undef CPU_OP_LABEL
+op_illegal:
+    return -1;
+#else
+    d = cpu_fetch(st, &scratch, NULL);
+    st->PC += d->length; cpu_tick(st);
+    switch (d->opcode) {
+#define CPU_OP_CASE(opc, mn, mode, kind, cyc) case opc: cpu_op_##mn##_##mode(st, d->operand); break;
+        CPU_OPCODE_TABLE(CPU_OP_CASE)
+#undef CPU_OP_CASE
         default: return -1;
     }
 
     return 0;
+#endif
 }
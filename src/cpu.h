@@ -5,12 +5,15 @@
 #define __CPU_H__
 
 #include <inttypes.h>
+#include <stddef.h>
+#include "cpu_opcodes.h"
 
 typedef uint16_t u16;
 typedef int16_t s16;
 typedef uint8_t u8;
 typedef int8_t s8;
 typedef uint32_t u32;
+typedef uint64_t u64;
 
 typedef union {
     struct {
@@ -26,13 +29,41 @@ typedef union {
     u8 data;
 } cpu_sr_t;
 
+// A decoded instruction. The decoder reads the opcode and operand bytes once
+// so the handlers don't go back to the bus for them
+typedef struct {
+    const void *handler; // dispatch target in cpu_exec, if any
+    u16 operand;
+    u8 opcode;
+    u8 length;
+    u8 block_len; // instructions left in the basic block, 0 if not decoded yet
+    u8 idle_cycles; // cycles per round if an idle loop starts here, else 0
+} cpu_decoded_t;
+
+// Decoded instructions for a read-only region (PRG-ROM), one entry per address.
+// Must be flushed whenever the bytes behind the region change (bank switch)
+typedef struct {
+    u16 base;
+    u32 size;
+    cpu_decoded_t *entries;
+} cpu_decode_cache_t;
+
+struct jit_t;
+
 typedef struct {
     u8 A;
     u8 Y;
     u8 X;
     u16 PC;
     u8 S;
-    cpu_sr_t P;
+    cpu_sr_t P; // N Z C V are stale, read P through cpu_get_p
+
+    // N, Z, C and V are kept lazily: N is bit 7 of _n, Z is set when _z is 0,
+    // _c and _v are 0 or 1. Most instructions only store their result byte
+    u8 _n;
+    u8 _z;
+    u8 _c;
+    u8 _v;
 
     u8 IRQ;
     u8 NMI;
@@ -41,12 +72,84 @@ typedef struct {
     u8 (*bus_read)(u16);
     void (*bus_write)(u8, u16);
 
-    void (*tick)(void); 
+    // 256 byte pages of the address space backed by plain memory, NULL for
+    // pages that have to go through bus_read/bus_write
+    u8 *const *read_pages;
+    u8 *const *write_pages;
+
+    u64 cycles; // cycles run so far, the rest of the system catches up to it
+
+    cpu_decode_cache_t *decode_cache; // NULL to decode every instruction
+    struct jit_t *jit; // NULL to always interpret
+
+    // Up to which cycle the given addresses keep reading the same, 0 if they
+    // might not. Lets idle loops be skipped, NULL to never skip
+    u64 (*idle_until)(const u16 *addrs, int n);
+    u16 idle_pc;
+    u8 idle_count; // rounds of the loop at idle_pc in a row
+    u64 idle_cycle;
+    u64 idle_cycles_skipped;
 
 } cpu_state_t;
 
+// Counts one cycle. Nothing else runs here, the bus callbacks are expected to
+// bring the rest of the system up to date when they see a side effect
+static inline void cpu_tick(cpu_state_t *st) { st->cycles++; }
+
+static inline u8 cpu_read(cpu_state_t *st, u16 addr) {
+    u8 *page = st->read_pages[addr >> 8];
+    if (page != NULL) return page[addr & 0xFF];
+    return st->bus_read(addr);
+}
+
+static inline void cpu_write(cpu_state_t *st, u8 val, u16 addr) {
+    u8 *page = st->write_pages[addr >> 8];
+    if (page != NULL) page[addr & 0xFF] = val;
+    else st->bus_write(val, addr);
+}
+
+typedef enum {
+#define CPU_MNEMONIC_ENUM(mn) CPU_##mn,
+    CPU_MNEMONIC_TABLE(CPU_MNEMONIC_ENUM)
+#undef CPU_MNEMONIC_ENUM
+} cpu_mnemonic_t;
+
+typedef enum {
+#define CPU_MODE_ENUM(mode, len, fmt) CPU_MODE_##mode,
+    CPU_MODE_TABLE(CPU_MODE_ENUM)
+#undef CPU_MODE_ENUM
+} cpu_mode_t;
+
+typedef enum {
+    CPU_KIND_all,
+    CPU_KIND_read,
+    CPU_KIND_rmw,
+    CPU_KIND_write,
+    CPU_KIND_branch,
+    CPU_KIND_jmp,
+    CPU_KIND_jsr
+} cpu_kind_t;
+
+typedef struct {
+    cpu_mnemonic_t mnemonic;
+    cpu_mode_t mode;
+    cpu_kind_t kind;
+    u8 length; // 0 for illegal opcodes
+    u8 cycles;
+} cpu_opcode_t;
+
+extern const cpu_opcode_t cpu_opcodes[256];
+extern const char *cpu_mnemonic_names[];
+
 int cpu_exec(cpu_state_t *st);
 void cpu_reset(cpu_state_t *st);
 void cpu_state_to_str(cpu_state_t *st, char buf[64]);
+u8 cpu_get_p(const cpu_state_t *st);
+void cpu_set_p(cpu_state_t *st, u8 p);
+int cpu_disasm(u16 pc, const u8 bytes[3], char buf[32]);
+
+void cpu_decode_cache_init(cpu_state_t *st, u16 base, u32 size);
+void cpu_decode_cache_flush(cpu_state_t *st);
+void cpu_decode_cache_free(cpu_state_t *st);
 
 #endif
@@ -0,0 +1,195 @@
+// SPDX-License-Identifier: GPL-3.0-or-later
+// Copyright 2024 neov5
+
+#ifndef __CPU_OPCODES_H__
+#define __CPU_OPCODES_H__
+
+// Single source of truth for the instruction set. cpu.c expands these into
+// the opcode handlers and dispatch table, and the same rows feed the opcode
+// info table used by the disassembler.
+
+// X(mnemonic)
+#define CPU_MNEMONIC_TABLE(X) \
+    X(ILL) \
+    X(ADC) X(AND) X(ASL) X(BCC) X(BCS) X(BEQ) X(BIT) X(BMI) X(BNE) X(BPL) \
+    X(BRK) X(BVC) X(BVS) X(CLC) X(CLD) X(CLI) X(CLV) X(CMP) X(CPX) X(CPY) \
+    X(DEC) X(DEX) X(DEY) X(EOR) X(INC) X(INX) X(INY) X(JMP) X(JSR) X(LDA) \
+    X(LDX) X(LDY) X(LSR) X(NOP) X(ORA) X(PHA) X(PHP) X(PLA) X(PLP) X(ROL) \
+    X(ROR) X(RTI) X(RTS) X(SBC) X(SEC) X(SED) X(SEI) X(STA) X(STX) X(STY) \
+    X(TAX) X(TAY) X(TSX) X(TXA) X(TXS) X(TYA)
+
+// X(mode, instruction length, operand format)
+#define CPU_MODE_TABLE(X) \
+    X(imp, 1, "") \
+    X(acc, 1, " A") \
+    X(imm, 2, " #$%02hX") \
+    X(zpg, 2, " $%02hX") \
+    X(zpx, 2, " $%02hX,X") \
+    X(zpy, 2, " $%02hX,Y") \
+    X(abs, 3, " $%04hX") \
+    X(abx, 3, " $%04hX,X") \
+    X(aby, 3, " $%04hX,Y") \
+    X(ind, 3, " ($%04hX)") \
+    X(izx, 2, " ($%02hX,X)") \
+    X(izy, 2, " ($%02hX),Y") \
+    X(rel, 2, " $%04hX")
+
+// X(opcode, mnemonic, addressing mode, access kind, base cycles)
+//
+// the access kind picks the addressing mode helper (cpu_icl_<kind>_<mode>).
+// Base cycles don't include the page crossing penalty of indexed reads or
+// the extra cycles of a taken branch
+#define CPU_OPCODE_TABLE(X) \
+    X(0x00, BRK, imp, all,    7) \
+    X(0x01, ORA, izx, read,   6) \
+    X(0x05, ORA, zpg, read,   3) \
+    X(0x06, ASL, zpg, rmw,    5) \
+    X(0x08, PHP, imp, all,    3) \
+    X(0x09, ORA, imm, read,   2) \
+    X(0x0A, ASL, acc, rmw,    2) \
+    X(0x0D, ORA, abs, read,   4) \
+    X(0x0E, ASL, abs, rmw,    6) \
+    X(0x10, BPL, rel, branch, 2) \
+    X(0x11, ORA, izy, read,   5) \
+    X(0x15, ORA, zpx, read,   4) \
+    X(0x16, ASL, zpx, rmw,    6) \
+    X(0x18, CLC, imp, all,    2) \
+    X(0x19, ORA, aby, read,   4) \
+    X(0x1D, ORA, abx, read,   4) \
+    X(0x1E, ASL, abx, rmw,    7) \
+    X(0x20, JSR, abs, jsr,    6) \
+    X(0x21, AND, izx, read,   6) \
+    X(0x24, BIT, zpg, read,   3) \
+    X(0x25, AND, zpg, read,   3) \
+    X(0x26, ROL, zpg, rmw,    5) \
+    X(0x28, PLP, imp, all,    4) \
+    X(0x29, AND, imm, read,   2) \
+    X(0x2A, ROL, acc, rmw,    2) \
+    X(0x2C, BIT, abs, read,   4) \
+    X(0x2D, AND, abs, read,   4) \
+    X(0x2E, ROL, abs, rmw,    6) \
+    X(0x30, BMI, rel, branch, 2) \
+    X(0x31, AND, izy, read,   5) \
+    X(0x35, AND, zpx, read,   4) \
+    X(0x36, ROL, zpx, rmw,    6) \
+    X(0x38, SEC, imp, all,    2) \
+    X(0x39, AND, aby, read,   4) \
+    X(0x3D, AND, abx, read,   4) \
+    X(0x3E, ROL, abx, rmw,    7) \
+    X(0x40, RTI, imp, all,    6) \
+    X(0x41, EOR, izx, read,   6) \
+    X(0x45, EOR, zpg, read,   3) \
+    X(0x46, LSR, zpg, rmw,    5) \
+    X(0x48, PHA, imp, all,    3) \
+    X(0x49, EOR, imm, read,   2) \
+    X(0x4A, LSR, acc, rmw,    2) \
+    X(0x4C, JMP, abs, jmp,    3) \
+    X(0x4D, EOR, abs, read,   4) \
+    X(0x4E, LSR, abs, rmw,    6) \
+    X(0x50, BVC, rel, branch, 2) \
+    X(0x51, EOR, izy, read,   5) \
+    X(0x55, EOR, zpx, read,   4) \
+    X(0x56, LSR, zpx, rmw,    6) \
+    X(0x58, CLI, imp, all,    2) \
+    X(0x59, EOR, aby, read,   4) \
+    X(0x5D, EOR, abx, read,   4) \
+    X(0x5E, LSR, abx, rmw,    7) \
+    X(0x60, RTS, imp, all,    6) \
+    X(0x61, ADC, izx, read,   6) \
+    X(0x65, ADC, zpg, read,   3) \
+    X(0x66, ROR, zpg, rmw,    5) \
+    X(0x68, PLA, imp, all,    4) \
+    X(0x69, ADC, imm, read,   2) \
+    X(0x6A, ROR, acc, rmw,    2) \
+    X(0x6C, JMP, ind, jmp,    5) \
+    X(0x6D, ADC, abs, read,   4) \
+    X(0x6E, ROR, abs, rmw,    6) \
+    X(0x70, BVS, rel, branch, 2) \
+    X(0x71, ADC, izy, read,   5) \
+    X(0x75, ADC, zpx, read,   4) \
+    X(0x76, ROR, zpx, rmw,    6) \
+    X(0x78, SEI, imp, all,    2) \
+    X(0x79, ADC, aby, read,   4) \
+    X(0x7D, ADC, abx, read,   4) \
+    X(0x7E, ROR, abx, rmw,    7) \
+    X(0x81, STA, izx, write,  6) \
+    X(0x84, STY, zpg, write,  3) \
+    X(0x85, STA, zpg, write,  3) \
+    X(0x86, STX, zpg, write,  3) \
+    X(0x88, DEY, imp, all,    2) \
+    X(0x8A, TXA, imp, all,    2) \
+    X(0x8C, STY, abs, write,  4) \
+    X(0x8D, STA, abs, write,  4) \
+    X(0x8E, STX, abs, write,  4) \
+    X(0x90, BCC, rel, branch, 2) \
+    X(0x91, STA, izy, write,  6) \
+    X(0x94, STY, zpx, write,  4) \
+    X(0x95, STA, zpx, write,  4) \
+    X(0x96, STX, zpy, write,  4) \
+    X(0x98, TYA, imp, all,    2) \
+    X(0x99, STA, aby, write,  5) \
+    X(0x9A, TXS, imp, all,    2) \
+    X(0x9D, STA, abx, write,  5) \
+    X(0xA0, LDY, imm, read,   2) \
+    X(0xA1, LDA, izx, read,   6) \
+    X(0xA2, LDX, imm, read,   2) \
+    X(0xA4, LDY, zpg, read,   3) \
+    X(0xA5, LDA, zpg, read,   3) \
+    X(0xA6, LDX, zpg, read,   3) \
+    X(0xA8, TAY, imp, all,    2) \
+    X(0xA9, LDA, imm, read,   2) \
+    X(0xAA, TAX, imp, all,    2) \
+    X(0xAC, LDY, abs, read,   4) \
+    X(0xAD, LDA, abs, read,   4) \
+    X(0xAE, LDX, abs, read,   4) \
+    X(0xB0, BCS, rel, branch, 2) \
+    X(0xB1, LDA, izy, read,   5) \
+    X(0xB4, LDY, zpx, read,   4) \
+    X(0xB5, LDA, zpx, read,   4) \
+    X(0xB6, LDX, zpy, read,   4) \
+    X(0xB8, CLV, imp, all,    2) \
+    X(0xB9, LDA, aby, read,   4) \
+    X(0xBA, TSX, imp, all,    2) \
+    X(0xBC, LDY, abx, read,   4) \
+    X(0xBD, LDA, abx, read,   4) \
+    X(0xBE, LDX, aby, read,   4) \
+    X(0xC0, CPY, imm, read,   2) \
+    X(0xC1, CMP, izx, read,   6) \
+    X(0xC4, CPY, zpg, read,   3) \
+    X(0xC5, CMP, zpg, read,   3) \
+    X(0xC6, DEC, zpg, rmw,    5) \
+    X(0xC8, INY, imp, all,    2) \
+    X(0xC9, CMP, imm, read,   2) \
+    X(0xCA, DEX, imp, all,    2) \
+    X(0xCC, CPY, abs, read,   4) \
+    X(0xCD, CMP, abs, read,   4) \
+    X(0xCE, DEC, abs, rmw,    6) \
+    X(0xD0, BNE, rel, branch, 2) \
+    X(0xD1, CMP, izy, read,   5) \
+    X(0xD5, CMP, zpx, read,   4) \
+    X(0xD6, DEC, zpx, rmw,    6) \
+    X(0xD8, CLD, imp, all,    2) \
+    X(0xD9, CMP, aby, read,   4) \
+    X(0xDD, CMP, abx, read,   4) \
+    X(0xDE, DEC, abx, rmw,    7) \
+    X(0xE0, CPX, imm, read,   2) \
+    X(0xE1, SBC, izx, read,   6) \
+    X(0xE4, CPX, zpg, read,   3) \
+    X(0xE5, SBC, zpg, read,   3) \
+    X(0xE6, INC, zpg, rmw,    5) \
+    X(0xE8, INX, imp, all,    2) \
+    X(0xE9, SBC, imm, read,   2) \
+    X(0xEA, NOP, imp, all,    2) \
+    X(0xEC, CPX, abs, read,   4) \
+    X(0xED, SBC, abs, read,   4) \
+    X(0xEE, INC, abs, rmw,    6) \
+    X(0xF0, BEQ, rel, branch, 2) \
+    X(0xF1, SBC, izy, read,   5) \
+    X(0xF5, SBC, zpx, read,   4) \
+    X(0xF6, INC, zpx, rmw,    6) \
+    X(0xF8, SED, imp, all,    2) \
+    X(0xF9, SBC, aby, read,   4) \
+    X(0xFD, SBC, abx, read,   4) \
+    X(0xFE, INC, abx, rmw,    7)
+
+#endif
@@ -4,71 +4,285 @@
 #include "disp.h"
 #include "types.h"
 #include "nes.h"
+#include "hash.h"
+#include "pace.h"
 #include "log.h"
-#include <time.h>
-#include <SDL2/SDL.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <string.h>
 
 extern nes_state_t state;
 
-static SDL_Window *win;
-static SDL_Surface *surf;
+static const disp_backend_t *const backends[] = {
+#ifndef NES_HEADLESS
+    &disp_sdl,
+#endif
+    &disp_null
+};
 
-int disp_init() {
-    int err;
-    if ((err = SDL_Init(SDL_INIT_VIDEO))) {
-        log_fatal("Could not initialize SDL: %s", SDL_GetError());
-        return err;
+#ifndef NES_HEADLESS
+static const disp_backend_t *disp = &disp_sdl;
+#else
+static const disp_backend_t *disp = &disp_null;
+#endif
+
+bool disp_set_backend(const char *name) {
+    for (size_t i=0; i<sizeof(backends)/sizeof(backends[0]); i++) {
+        if (strcmp(backends[i]->name, name) == 0) {
+            disp = backends[i];
+            return true;
+        }
     }
+    return false;
+}
 
-#ifdef NES_DEBUG
-    SDL_DisplayMode disp_mode;
-    SDL_GetCurrentDisplayMode(0, &disp_mode);
-    int screen_height = disp_mode.h;
-    win = SDL_CreateWindow("brightNES (Debug Mode)", 0, screen_height-480, 512, 480, SDL_WINDOW_SHOWN);
-#else
-    win = SDL_CreateWindow("brightNES", 100, 100, 512, 480, SDL_WINDOW_SHOWN);
+const char *disp_name() {
+    return disp->name;
+}
+
+bool disp_suppressed;
+
+void disp_suppress(bool on) {
+    disp_suppressed = on;
+}
+
+u8 disp_frame[DISP_HEIGHT * DISP_WIDTH];
+u8 disp_emphasis[DISP_HEIGHT];
+
+// the 64 colors under each of the 8 emphasis settings, in the backend's
+// format and as 0x00RRGGBB. Frames are hashed as 0x00RRGGBB pixels, the same
+// for every backend
+static u32 colors[512];
+static u32 rgb_colors[512];
+static bool colors_are_rgb;
+static u32 pixels[DISP_HEIGHT * DISP_WIDTH];
+static u32 rgb_pixels[DISP_HEIGHT * DISP_WIDTH];
+
+static bool hashing;
+static u64 frame_hash;
+
+void disp_hash_frames(bool on) {
+    hashing = on;
+}
+
+u64 disp_frame_hash() {
+    return frame_hash;
+}
+
+static void disp_convert_line(u32 *out, const u8 *in, const u32 *table) {
+    for (u32 x = 0; x < DISP_WIDTH; x += 8) {
+        out[x+0] = table[in[x+0]]; out[x+1] = table[in[x+1]];
+        out[x+2] = table[in[x+2]]; out[x+3] = table[in[x+3]];
+        out[x+4] = table[in[x+4]]; out[x+5] = table[in[x+5]];
+        out[x+6] = table[in[x+6]]; out[x+7] = table[in[x+7]];
+    }
+}
+
+#if defined(__x86_64__) && defined(__GNUC__)
+#include <immintrin.h>
+
+// 8 pixels at a time, widened to 32 bit indices and gathered from the table
+__attribute__((target("avx2")))
+static void disp_convert_line_avx2(u32 *out, const u8 *in, const u32 *table) {
+    for (u32 x = 0; x < DISP_WIDTH; x += 8) {
+        __m256i idx = _mm256_cvtepu8_epi32(_mm_loadl_epi64((const __m128i*)(in + x)));
+        _mm256_storeu_si256((__m256i*)(out + x), _mm256_i32gather_epi32((const int*)table, idx, 4));
+    }
+}
 #endif
-    if (win == NULL) {
-        log_fatal("Could not create Window: %s", SDL_GetError());
-        SDL_Quit();
-        return -1;
+
+static void (*convert_line)(u32 *out, const u8 *in, const u32 *table) = disp_convert_line;
+
+static void disp_convert(u32 *out, const u8 *frame, const u8 *emphasis, const u32 *table) {
+    for (u32 y = 0; y < DISP_HEIGHT; y++) {
+        convert_line(out + y*DISP_WIDTH, frame + y*DISP_WIDTH, table + (emphasis[y] << 6));
     }
+}
+
+static u64 shown, dropped, convert_ns, blit_ns, blit_max_ns;
+
+static void disp_present(const u8 *frame, const u8 *emphasis) {
+    u64 t0 = pace_now();
+    disp_convert(pixels, frame, emphasis, colors);
+    u64 t1 = pace_now();
+    disp->blit(pixels);
+    u64 t2 = pace_now();
+    shown++;
+    convert_ns += t1 - t0;
+    blit_ns += t2 - t1;
+    if (t2 - t1 > blit_max_ns) blit_max_ns = t2 - t1;
+}
 
-    surf = SDL_GetWindowSurface(win);
-    if (surf == NULL) {
-        SDL_DestroyWindow(win);
-        log_fatal("Could not create Surface: %s", SDL_GetError());
-        SDL_Quit();
-        return -1;
+// Backends with own_thread set stay on the thread that made the window, as
+// SDL wants, while the emulation runs on a thread of its own (disp_run).
+// Finished frames go over through a triple buffer: the emulation fills back,
+// swaps it with latest and never waits or locks, the window thread swaps
+// latest with front whenever a new one is there. Frames it didn't get to in
+// time are replaced by newer ones, unless vsync is on: then the screen paces
+// the emulation, which waits for the last frame it handed over to be shown
+// before it swaps in the next one. The window thread sleeps in the backend's
+// wait until there's input or a frame, the emulation wakes it when latest
+// turns fresh. Input comes back the other way, as the keys held the last
+// time the window thread looked
+typedef struct {
+    u8 frame[DISP_HEIGHT * DISP_WIDTH];
+    u8 emphasis[DISP_HEIGHT];
+} disp_slot_t;
+
+#define DISP_SLOT_FRESH 0x4 // latest holds a frame front hasn't had
+
+static struct {
+    bool running;
+    pthread_t thread;
+    disp_slot_t slots[3];
+    u32 back, front; // owned by the emulation and by the window thread
+    atomic_uint latest;
+
+    // frames handed over and presented, for waiting on vsync
+    u64 handed, presented;
+    pthread_mutex_t lock;
+    pthread_cond_t presented_cond;
+
+    atomic_uchar buttons, hotkeys;
+    atomic_bool quit; // the window was closed
+    atomic_bool done; // the emulation returned
+
+    void (*emulate)(void *);
+    void *arg;
+} present = { .back = 0, .latest = 1, .front = 2,
+    .lock = PTHREAD_MUTEX_INITIALIZER, .presented_cond = PTHREAD_COND_INITIALIZER };
+
+static bool vsync;
+
+static void *disp_emulate(void *unused) {
+    present.emulate(present.arg);
+    atomic_store(&present.done, true);
+    disp->wake();
+    return unused;
+}
+
+void disp_run(void (*emulate)(void *), void *arg) {
+    present.emulate = emulate;
+    present.arg = arg;
+    present.running = disp->own_thread;
+    if (present.running && pthread_create(&present.thread, NULL, disp_emulate, NULL) != 0) {
+        log_warn("Could not start the emulation thread, presenting from it");
+        present.running = false;
+    }
+    if (!present.running) {
+        emulate(arg);
+        return;
     }
 
-    return 0;
+    while (!atomic_load(&present.done)) {
+        u8 buttons, hotkeys;
+        if (disp->poll(&buttons, &hotkeys)) atomic_store(&present.quit, true);
+        atomic_store(&present.buttons, buttons);
+        atomic_store(&present.hotkeys, hotkeys);
+
+        if (atomic_load(&present.latest) & DISP_SLOT_FRESH) {
+            present.front = atomic_exchange(&present.latest, present.front) & 0x3;
+            disp_slot_t *slot = &present.slots[present.front];
+            disp_present(slot->frame, slot->emphasis);
+            if (vsync) {
+                pthread_mutex_lock(&present.lock);
+                present.presented++;
+                pthread_cond_signal(&present.presented_cond);
+                pthread_mutex_unlock(&present.lock);
+            }
+        }
+        else disp->wait();
+    }
+    pthread_join(present.thread, NULL);
+    present.running = false;
+}
+
+int disp_init() {
+#if defined(__x86_64__) && defined(__GNUC__)
+    if (__builtin_cpu_supports("avx2")) convert_line = disp_convert_line_avx2;
+#endif
+    return disp->init();
+}
+
+// Each emphasis bit darkens the two other channels, by about as much as
+// the PPU's attenuator does (0.816)
+static u8 disp_attenuate(u8 c, u8 emphasis, u8 keep) {
+    for (u8 bit = 1; bit < 8; bit <<= 1) {
+        if ((emphasis & bit) && bit != keep) c = c * 209 / 256;
+    }
+    return c;
 }
 
-void disp_putpixel(u32 x, u32 y, u8 r, u8 g, u8 b) {
-    x *= 2;
-    y *= 2;
-    Uint32 color = SDL_MapRGB(surf->format, r, g, b);
-    ((Uint32*)surf->pixels)[(y*surf->w) + x] = color;
-    ((Uint32*)surf->pixels)[((y+1)*surf->w) + x] = color;
-    ((Uint32*)surf->pixels)[((y+1)*surf->w) + x + 1] = color;
-    ((Uint32*)surf->pixels)[(y*surf->w) + x + 1] = color;
+void disp_set_palette(const u8 *rgb) {
+    colors_are_rgb = true;
+    for (u32 i = 0; i < 512; i++) {
+        u8 emphasis = i >> 6;
+        const u8 *c = &rgb[(i & 0x3F) * 3];
+        u8 r = disp_attenuate(c[0], emphasis, 0x1);
+        u8 g = disp_attenuate(c[1], emphasis, 0x2);
+        u8 b = disp_attenuate(c[2], emphasis, 0x4);
+        colors[i] = disp->map_rgb(r, g, b);
+        rgb_colors[i] = ((u32)r << 16) | ((u32)g << 8) | b;
+        colors_are_rgb &= colors[i] == rgb_colors[i];
+    }
 }
 
 void disp_blit() {
-    SDL_UpdateWindowSurface(win);
+    if (!disp_suppressed) {
+        if (present.running) {
+            disp_slot_t *slot = &present.slots[present.back];
+            memcpy(slot->frame, disp_frame, sizeof(disp_frame));
+            memcpy(slot->emphasis, disp_emphasis, sizeof(disp_emphasis));
+            if (vsync) {
+                pthread_mutex_lock(&present.lock);
+                while (present.presented < present.handed) pthread_cond_wait(&present.presented_cond, &present.lock);
+                pthread_mutex_unlock(&present.lock);
+                present.handed++;
+            }
+            u32 old = atomic_exchange(&present.latest, present.back | DISP_SLOT_FRESH);
+            // a fresh one was still there, the window thread is already woken
+            if (old & DISP_SLOT_FRESH) dropped++;
+            else disp->wake();
+            present.back = old & 0x3;
+        }
+        else disp_present(disp_frame, disp_emphasis);
+
+        if (hashing) {
+            const u32 *out = pixels;
+            if (present.running || !colors_are_rgb) {
+                disp_convert(rgb_pixels, disp_frame, disp_emphasis, rgb_colors);
+                out = rgb_pixels;
+            }
+            frame_hash = hash64(out, sizeof(rgb_pixels));
+        }
+    }
     state.frame_done = true;
-    // clock_t toc = clock();
-    // if (disp_ctr > 0) {
-    //     double time = (double)(toc-tic)/CLOCKS_PER_SEC;
-    //     log_info("fps: %f", 1./time);
-    // }
-    // tic = toc;
-    // disp_ctr++;
+}
+
+bool disp_poll(u8 *buttons, u8 *hotkeys) {
+    if (!present.running) return disp->poll(buttons, hotkeys);
+    *buttons = atomic_load(&present.buttons);
+    *hotkeys = atomic_load(&present.hotkeys);
+    return atomic_load(&present.quit);
+}
+
+void disp_set_scale(disp_scale_t scale) {
+    disp->scale(scale);
+}
+
+bool disp_set_vsync(bool on) {
+    bool ok = disp->vsync(on);
+    vsync = on && ok;
+    return ok;
+}
+
+void disp_print_stats(FILE *f) {
+    if (!shown) return;
+    fprintf(f, "presenting %" PRIu64 " frames: convert %.3f ms, %s blit %.3f ms (max %.3f ms) per frame\n",
+            shown, convert_ns / 1e6 / shown, disp->name, blit_ns / 1e6 / shown, blit_max_ns / 1e6);
+    if (disp->own_thread) fprintf(f, "%" PRIu64 " frames replaced before the window thread got to them\n", dropped);
 }
 
 int disp_free() {
-    SDL_DestroyWindowSurface(win);
-    SDL_DestroyWindow(win);
-    return 0;
+    return disp->free();
 }
@@ -5,10 +5,103 @@
 #define __DISP_H__
 
 #include "types.h"
+#include <stdbool.h>
+#include <stdio.h>
+
+#define DISP_WIDTH 256
+#define DISP_HEIGHT 240
+
+// Emulator controls, next to the joypad buttons
+typedef enum {
+    DISP_KEY_REWIND = 0x1,
+    DISP_KEY_FAST_FORWARD = 0x2
+} disp_hotkey_t;
+
+// How a frame fills a window bigger than it, always keeping its aspect
+typedef enum {
+    DISP_SCALE_INTEGER, // the largest whole multiple that fits
+    DISP_SCALE_FIT,     // as large as fits, square pixels
+    DISP_SCALE_NTSC     // as large as fits, 8:7 pixels like on a TV
+} disp_scale_t;
+
+// Where frames go and where input comes from. The ppu draws palette indices
+// with disp_putpixel, disp_blit turns the frame into the backend's pixel
+// format in one pass and hands it over
+typedef struct {
+    const char *name;
+    int (*init)();
+    u32 (*map_rgb)(u8 r, u8 g, u8 b); // to the pixel format blit takes
+    void (*blit)(const u32 *pixels); // DISP_WIDTH x DISP_HEIGHT
+    bool (*poll)(u8 *buttons, u8 *hotkeys); // fills the held keys, true to quit
+    void (*scale)(disp_scale_t scale);
+    bool (*vsync)(bool on); // blit waits for the screen's refresh, false if it can't
+    int (*free)();
+    bool own_thread; // everything stays on the thread of init, see disp_run
+    // with own_thread, wait blocks until there's input to poll or wake was
+    // called, which any thread can do
+    void (*wait)();
+    void (*wake)();
+} disp_backend_t;
+
+#ifndef NES_HEADLESS
+extern const disp_backend_t disp_sdl; // window through SDL2
+#endif
+extern const disp_backend_t disp_null; // frames kept in memory, no input
+
+// Picks the backend by name, before disp_init. False if there's none by
+// that name in this build
+bool disp_set_backend(const char *name);
+const char *disp_name();
 
 int disp_init();
-void disp_putpixel(u32 x, u32 y, u8 r, u8 g, u8 b);
+// Runs emulate(arg) until it returns. Backends with own_thread keep the
+// thread that called disp_init for themselves, presenting frames and reading
+// input there while emulate runs on another. Call disp_free after it on the
+// same thread
+void disp_run(void (*emulate)(void *), void *arg);
+// The 64 colors as RGB triples, after disp_init
+void disp_set_palette(const u8 *rgb);
 void disp_blit();
+bool disp_poll(u8 *buttons, u8 *hotkeys);
 int disp_free();
 
+// After disp_init and before disp_run, windows start out at
+// DISP_SCALE_INTEGER
+void disp_set_scale(disp_scale_t scale);
+
+// Locks presentation to the screen's refresh, after disp_init and before
+// disp_run. Frames are then paced by the screen and not at the NES rate.
+// False if the backend can't
+bool disp_set_vsync(bool on);
+
+// While suppressed, frames are still finished but nothing is drawn, shown or
+// hashed. For frames that are emulated but never seen. The ppu checks
+// disp_suppressed itself to skip its pixel output
+extern bool disp_suppressed;
+void disp_suppress(bool on);
+
+// Hash every frame on disp_blit, to check that changes don't alter the
+// picture. disp_frame_hash is the one of the last frame
+void disp_hash_frames(bool on);
+u64 disp_frame_hash();
+
+// Time spent on frames that were shown, converting them and in the backend's
+// blit (which includes waiting for vsync when it's on)
+void disp_print_stats(FILE *f);
+
+// The frame being drawn, a 6 bit palette index per pixel, and the emphasis
+// bits of PPUMASK (>> 5) each line started with. 60 KB for headless
+// consumers to read without any color conversion
+extern u8 disp_frame[DISP_HEIGHT * DISP_WIDTH];
+extern u8 disp_emphasis[DISP_HEIGHT];
+
+static inline void disp_putpixel(u32 x, u32 y, u8 index, u8 emphasis) {
+    disp_frame[y*DISP_WIDTH + x] = index;
+    if (x == 0) disp_emphasis[y] = emphasis;
+}
+
+// The last frame the null backend got, DISP_WIDTH x DISP_HEIGHT 0x00RRGGBB.
+// NULL before the first
+const u32 *disp_null_pixels();
+
 #endif
@@ -0,0 +1,55 @@
+// SPDX-License-Identifier: GPL-3.0-or-later
+// Copyright 2024 neov5
+
+#include "disp.h"
+#include "types.h"
+
+// Headless display, for servers and for measuring emulation on its own
+
+static const u32 *last;
+
+static int disp_null_init() {
+    return 0;
+}
+
+static u32 disp_null_map_rgb(u8 r, u8 g, u8 b) {
+    return ((u32)r << 16) | ((u32)g << 8) | b;
+}
+
+// the frame stays where disp.c converted it until the next one
+static void disp_null_blit(const u32 *pixels) {
+    last = pixels;
+}
+
+static bool disp_null_poll(u8 *buttons, u8 *hotkeys) {
+    *buttons = 0;
+    *hotkeys = 0;
+    return false;
+}
+
+static void disp_null_scale(disp_scale_t scale) {
+    (void)scale; // nothing to scale
+}
+
+static bool disp_null_vsync(bool on) {
+    return !on;
+}
+
+static int disp_null_free() {
+    return 0;
+}
+
+const u32 *disp_null_pixels() {
+    return last;
+}
+
+const disp_backend_t disp_null = {
+    .name = "null",
+    .init = disp_null_init,
+    .map_rgb = disp_null_map_rgb,
+    .blit = disp_null_blit,
+    .poll = disp_null_poll,
+    .scale = disp_null_scale,
+    .vsync = disp_null_vsync,
+    .free = disp_null_free
+};
@@ -0,0 +1,151 @@
+// SPDX-License-Identifier: GPL-3.0-or-later
+// Copyright 2024 neov5
+
+#include "disp.h"
+#include "types.h"
+#include "joypad.h"
+#include "log.h"
+#include <SDL2/SDL.h>
+
+static SDL_Window *win;
+static SDL_Renderer *ren;
+static SDL_Texture *tex; // the native 256x240 frame, scaled by the renderer
+static Uint32 wake_event; // pushed by disp_sdl_wake
+
+static int disp_sdl_init() {
+    int err;
+    if ((err = SDL_Init(SDL_INIT_VIDEO))) {
+        log_fatal("Could not initialize SDL: %s", SDL_GetError());
+        return err;
+    }
+
+#ifdef NES_DEBUG
+    SDL_DisplayMode disp_mode;
+    SDL_GetCurrentDisplayMode(0, &disp_mode);
+    int screen_height = disp_mode.h;
+    win = SDL_CreateWindow("brightNES (Debug Mode)", 0, screen_height-480, 512, 480,
+                           SDL_WINDOW_SHOWN | SDL_WINDOW_RESIZABLE);
+#else
+    win = SDL_CreateWindow("brightNES", 100, 100, 512, 480, SDL_WINDOW_SHOWN | SDL_WINDOW_RESIZABLE);
+#endif
+    if (win == NULL) {
+        log_fatal("Could not create Window: %s", SDL_GetError());
+        SDL_Quit();
+        return -1;
+    }
+
+    // any renderer does, the software one too
+    ren = SDL_CreateRenderer(win, -1, 0);
+    if (ren == NULL) ren = SDL_CreateRenderer(win, -1, SDL_RENDERER_SOFTWARE);
+    if (ren == NULL) {
+        log_fatal("Could not create Renderer: %s", SDL_GetError());
+        SDL_DestroyWindow(win);
+        SDL_Quit();
+        return -1;
+    }
+
+    SDL_SetHint(SDL_HINT_RENDER_SCALE_QUALITY, "nearest");
+    tex = SDL_CreateTexture(ren, SDL_PIXELFORMAT_RGB888, SDL_TEXTUREACCESS_STREAMING,
+                            DISP_WIDTH, DISP_HEIGHT);
+    if (tex == NULL) {
+        log_fatal("Could not create Texture: %s", SDL_GetError());
+        SDL_DestroyRenderer(ren);
+        SDL_DestroyWindow(win);
+        SDL_Quit();
+        return -1;
+    }
+
+    SDL_RenderSetLogicalSize(ren, DISP_WIDTH, DISP_HEIGHT);
+    SDL_RenderSetIntegerScale(ren, SDL_TRUE);
+
+    wake_event = SDL_RegisterEvents(1);
+    if (wake_event == (Uint32)-1) wake_event = SDL_USEREVENT;
+    return 0;
+}
+
+// the texture is SDL_PIXELFORMAT_RGB888, 0x00RRGGBB
+static u32 disp_sdl_map_rgb(u8 r, u8 g, u8 b) {
+    return ((u32)r << 16) | ((u32)g << 8) | b;
+}
+
+static void disp_sdl_blit(const u32 *pixels) {
+    SDL_UpdateTexture(tex, NULL, pixels, DISP_WIDTH * sizeof(u32));
+    SDL_RenderClear(ren);
+    SDL_RenderCopy(ren, tex, NULL, NULL);
+    SDL_RenderPresent(ren);
+}
+
+// The logical size letterboxes the picture into whatever size the window is.
+// NES pixels are 8:7 on a TV, so the ntsc scale makes the picture 292 wide
+static void disp_sdl_scale(disp_scale_t scale) {
+    SDL_RenderSetLogicalSize(ren, scale == DISP_SCALE_NTSC ? 292 : DISP_WIDTH, DISP_HEIGHT);
+    SDL_RenderSetIntegerScale(ren, scale == DISP_SCALE_INTEGER ? SDL_TRUE : SDL_FALSE);
+}
+
+static bool disp_sdl_poll(u8 *buttons, u8 *hotkeys) {
+    SDL_Event event;
+    bool exit = false;
+    while(SDL_PollEvent(&event)) {
+        // TODO process other events too
+        // TODO SDL stalls when the window moves to another display (tested
+        // on MacOS 14, moving from a retina to a non-retina display stalls
+        // the emulator. Moving back doesn't unstall it)
+        if (event.type == SDL_QUIT || (event.type == SDL_WINDOWEVENT &&
+                                       event.window.event == SDL_WINDOWEVENT_CLOSE)) {
+            exit = true;
+        }
+    }
+
+    *buttons = 0;
+    SDL_PumpEvents();
+    int numkeys;
+    const Uint8* kb_state = SDL_GetKeyboardState(&numkeys);
+    if (kb_state[SDL_SCANCODE_Q]) *buttons |= BTN_SELECT;
+    if (kb_state[SDL_SCANCODE_W]) *buttons |= BTN_START;
+    if (kb_state[SDL_SCANCODE_A]) *buttons |= BTN_B;
+    if (kb_state[SDL_SCANCODE_S]) *buttons |= BTN_A;
+    if (kb_state[SDL_SCANCODE_UP]) *buttons |= BTN_UP;
+    if (kb_state[SDL_SCANCODE_DOWN]) *buttons |= BTN_DOWN;
+    if (kb_state[SDL_SCANCODE_RIGHT]) *buttons |= BTN_RIGHT;
+    if (kb_state[SDL_SCANCODE_LEFT]) *buttons |= BTN_LEFT;
+
+    *hotkeys = 0;
+    if (kb_state[SDL_SCANCODE_BACKSPACE]) *hotkeys |= DISP_KEY_REWIND;
+    if (kb_state[SDL_SCANCODE_TAB]) *hotkeys |= DISP_KEY_FAST_FORWARD;
+    return exit;
+}
+
+// Leaves the event in the queue, disp_sdl_poll drains it along with any wakes
+static void disp_sdl_wait() {
+    SDL_WaitEvent(NULL);
+}
+
+static void disp_sdl_wake() {
+    SDL_Event event = { .type = wake_event };
+    SDL_PushEvent(&event);
+}
+
+static bool disp_sdl_vsync(bool on) {
+    return SDL_RenderSetVSync(ren, on) == 0;
+}
+
+static int disp_sdl_free() {
+    SDL_DestroyTexture(tex);
+    SDL_DestroyRenderer(ren);
+    SDL_DestroyWindow(win);
+    return 0;
+}
+
+const disp_backend_t disp_sdl = {
+    .name = "sdl",
+    .init = disp_sdl_init,
+    .map_rgb = disp_sdl_map_rgb,
+    .blit = disp_sdl_blit,
+    .poll = disp_sdl_poll,
+    .scale = disp_sdl_scale,
+    .vsync = disp_sdl_vsync,
+    .free = disp_sdl_free,
+    .own_thread = true,
+    .wait = disp_sdl_wait,
+    .wake = disp_sdl_wake
+};
@@ -6,14 +6,15 @@
 #include "log.h"
 
 // alignment will be handled externally
-// this method takes 513 cycles
-void dma_oam(dma_oam_t *dma, cpu_state_t *cpu_st, ppu_state_t *ppu_st) {
-    cpu_st->tick();
+// this method takes 513 cycles. OAM is written through $2004 so the ppu is
+// caught up before every write
+void dma_oam(dma_oam_t *dma, cpu_state_t *cpu_st) {
+    cpu_tick(cpu_st);
     u16 addr = dma->addr <<= 8;
     for (u16 i=addr; i<=(addr | 0xFF); i++) {
-        u8 val = cpu_st->bus_read(i);
-        cpu_st->tick();
-        ppu_oamdata_write(ppu_st, val);
-        cpu_st->tick();
+        u8 val = cpu_read(cpu_st, i);
+        cpu_tick(cpu_st);
+        cpu_write(cpu_st, val, 0x2004);
+        cpu_tick(cpu_st);
     }
 }
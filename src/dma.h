@@ -10,10 +10,9 @@
 
 typedef struct {
     u16 addr;
-    bool enabled;
 } dma_oam_t;
 
-void dma_oam(dma_oam_t *dma, cpu_state_t *cpu_st, ppu_state_t *ppu_st);
+void dma_oam(dma_oam_t *dma, cpu_state_t *cpu_st);
 void dma_dmc(dma_oam_t *dma, cpu_state_t *cpu_st, ppu_state_t *ppu_st);
 
 #endif
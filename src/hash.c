@@ -0,0 +1,52 @@
+// SPDX-License-Identifier: GPL-3.0-or-later
+// Copyright 2024 neov5
+
+#include "hash.h"
+#include <string.h>
+
+#define HASH_P1 0x9E3779B185EBCA87ULL
+#define HASH_P2 0xC2B2AE3D27D4EB4FULL
+#define HASH_P3 0x165667B19E3779F9ULL
+
+static inline u64 hash_rotl(u64 x, int r) { return (x << r) | (x >> (64 - r)); }
+
+static inline u64 hash_round(u64 acc, u64 in) {
+    return hash_rotl(acc + in * HASH_P2, 31) * HASH_P1;
+}
+
+u64 hash64(const void *data, size_t len) {
+    const u8 *p = data;
+    size_t left = len;
+    u64 h;
+
+    if (left >= 32) {
+        // four independent lanes so the multiplies can overlap
+        u64 l[4] = { HASH_P1 + HASH_P2, HASH_P2, 0, -HASH_P1 };
+        do {
+            u64 w[4];
+            memcpy(w, p, sizeof(w));
+            for (int i=0; i<4; i++) l[i] = hash_round(l[i], w[i]);
+            p += 32;
+            left -= 32;
+        } while (left >= 32);
+        h = hash_rotl(l[0], 1) + hash_rotl(l[1], 7) + hash_rotl(l[2], 12) + hash_rotl(l[3], 18);
+    }
+    else h = HASH_P3;
+    h += len;
+
+    for (; left >= 8; left -= 8, p += 8) {
+        u64 w;
+        memcpy(&w, p, sizeof(w));
+        h = hash_rotl(h ^ hash_round(0, w), 27) * HASH_P1 + HASH_P2;
+    }
+    for (; left > 0; left--, p++) {
+        h = hash_rotl(h ^ (*p * HASH_P3), 11) * HASH_P1;
+    }
+
+    h ^= h >> 33;
+    h *= HASH_P2;
+    h ^= h >> 29;
+    h *= HASH_P3;
+    h ^= h >> 32;
+    return h;
+}
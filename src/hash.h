@@ -0,0 +1,14 @@
+// SPDX-License-Identifier: GPL-3.0-or-later
+// Copyright 2024 neov5
+
+#ifndef __HASH_H__
+#define __HASH_H__
+
+#include "types.h"
+#include <stddef.h>
+
+// Fast 64 bit hash in the style of xxHash64 (but not compatible with it),
+// for telling frames and states apart. Not for anything adversarial
+u64 hash64(const void *data, size_t len);
+
+#endif
@@ -0,0 +1,678 @@
+// SPDX-License-Identifier: GPL-3.0-or-later
+// Copyright 2024 neov5
+
+#include "jit.h"
+#include "log.h"
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+
+#if defined(__x86_64__) && (defined(__linux__) || defined(__APPLE__))
+
+#include <sys/mman.h>
+
+#define JIT_CODE_SIZE (4 << 20)
+#define JIT_HOT_THRESHOLD 32
+#define JIT_MAX_INSTR_BYTES 128 // generous upper bound for one instruction
+
+typedef int (*jit_fn_t)(cpu_state_t*, u8*);
+
+// x86-64 registers. The guest registers live in r8-r11 for the whole block,
+// rdi holds the cpu state, rsi the internal RAM and rbx counts the cycles
+// that depend on the data (page crossings, taken branches)
+enum {
+    RAX = 0, RCX = 1, RDX = 2, RBX = 3, RSI = 6, RDI = 7,
+    R8 = 8, R9 = 9, R10 = 10, R11 = 11
+};
+
+#define REG_A R8
+#define REG_X R9
+#define REG_Y R10
+#define REG_P R11
+
+// opcodes of the r/m32, r32 forms and the /digit of the r/m32, imm32 forms
+enum { OP_ADD = 0x01, OP_OR = 0x09, OP_AND = 0x21, OP_SUB = 0x29, OP_XOR = 0x31, OP_TEST = 0x85, OP_MOV = 0x89 };
+enum { EXT_ADD = 0, EXT_OR = 1, EXT_AND = 4, EXT_SUB = 5, EXT_XOR = 6 };
+enum { EXT_SHL = 4, EXT_SHR = 5 };
+enum { CC_Z = 0x4, CC_NZ = 0x5 };
+
+#define OP_MOVZX8 0x0FB6
+#define OP_STORE8 0x88
+
+// P register bits
+#define P_C 0x01
+#define P_Z 0x02
+#define P_D 0x08
+#define P_V 0x40
+#define P_N 0x80
+
+typedef struct {
+    u8 *p;
+    u8 *end;
+    bool overflow;
+} jit_buf_t;
+
+static void emit8(jit_buf_t *b, u8 v) {
+    if (b->p < b->end) *b->p++ = v;
+    else b->overflow = true;
+}
+
+static void emit32(jit_buf_t *b, u32 v) {
+    for (int i=0; i<4; i++) emit8(b, v >> (8*i));
+}
+
+static void emit_rex(jit_buf_t *b, int w, int r, int x, int rm) {
+    u8 rex = 0x40 | (w << 3) | (((r >> 3) & 1) << 2) | (((x >> 3) & 1) << 1) | ((rm >> 3) & 1);
+    if (rex != 0x40) emit8(b, rex);
+}
+
+// op r/m32, r32 with both operands in registers (op reg, rm for 0F xx)
+static void emit_rr(jit_buf_t *b, u16 op, int reg, int rm) {
+    emit_rex(b, 0, reg, 0, rm);
+    if (op > 0xFF) emit8(b, op >> 8);
+    emit8(b, op & 0xFF);
+    emit8(b, 0xC0 | ((reg & 7) << 3) | (rm & 7));
+}
+
+// op with a [base + index + disp32] memory operand, index < 0 for none
+static void emit_mem(jit_buf_t *b, u16 op, int reg, int base, int index, i32 disp) {
+    emit_rex(b, 0, reg, index < 0 ? 0 : index, base);
+    if (op > 0xFF) emit8(b, op >> 8);
+    emit8(b, op & 0xFF);
+    if (index < 0) {
+        emit8(b, 0x80 | ((reg & 7) << 3) | (base & 7));
+    }
+    else {
+        emit8(b, 0x84 | ((reg & 7) << 3));
+        emit8(b, ((index & 7) << 3) | (base & 7));
+    }
+    emit32(b, disp);
+}
+
+static void emit_ri(jit_buf_t *b, int ext, int rm, u32 imm) {
+    emit_rex(b, 0, 0, 0, rm);
+    emit8(b, 0x81);
+    emit8(b, 0xC0 | (ext << 3) | (rm & 7));
+    emit32(b, imm);
+}
+
+static void emit_test_ri(jit_buf_t *b, int rm, u32 imm) {
+    emit_rex(b, 0, 0, 0, rm);
+    emit8(b, 0xF7);
+    emit8(b, 0xC0 | (rm & 7));
+    emit32(b, imm);
+}
+
+static void emit_shift(jit_buf_t *b, int ext, int rm, u8 n) {
+    emit_rex(b, 0, 0, 0, rm);
+    emit8(b, 0xC1);
+    emit8(b, 0xC0 | (ext << 3) | (rm & 7));
+    emit8(b, n);
+}
+
+static void emit_mov_ri(jit_buf_t *b, int r, u32 imm) {
+    emit_rex(b, 0, 0, 0, r);
+    emit8(b, 0xB8 + (r & 7));
+    emit32(b, imm);
+}
+
+static void emit_mov_ri64(jit_buf_t *b, int r, u64 imm) {
+    emit_rex(b, 1, 0, 0, r);
+    emit8(b, 0xB8 + (r & 7));
+    emit32(b, imm);
+    emit32(b, imm >> 32);
+}
+
+static void emit_store16(jit_buf_t *b, int reg, int base, i32 disp) {
+    emit8(b, 0x66);
+    emit_mem(b, OP_MOV, reg, base, -1, disp);
+}
+
+// jcc rel32, returns where the displacement goes for jit_patch
+static u8 *emit_jcc(jit_buf_t *b, u8 cc) {
+    emit8(b, 0x0F);
+    emit8(b, 0x80 | cc);
+    u8 *rel = b->p;
+    emit32(b, 0);
+    return rel;
+}
+
+static void jit_patch(jit_buf_t *b, u8 *rel) {
+    if (b->overflow) return;
+    i32 disp = b->p - (rel + 4);
+    memcpy(rel, &disp, 4);
+}
+
+// N and Z from the byte in r, clobbers t
+static void emit_set_nz(jit_buf_t *b, int r, int t) {
+    emit_ri(b, EXT_AND, REG_P, ~(u32)(P_N | P_Z));
+    emit_rr(b, OP_MOV, r, t);
+    emit_ri(b, EXT_AND, t, P_N);
+    emit_rr(b, OP_OR, t, REG_P);
+    emit_rr(b, OP_TEST, r, r);
+    emit_rr(b, 0x0F94, 0, t); // setz
+    emit_rr(b, OP_MOVZX8, t, t);
+    emit_shift(b, EXT_SHL, t, 1);
+    emit_rr(b, OP_OR, t, REG_P);
+}
+
+// sets C from bit 0 of t
+static void emit_set_c(jit_buf_t *b, int t) {
+    emit_ri(b, EXT_AND, REG_P, ~(u32)P_C);
+    emit_rr(b, OP_OR, t, REG_P);
+}
+
+// Blocks keep the whole of P in a register, built from the lazy flags on
+// entry and split back into them on exit
+static void emit_load_p(jit_buf_t *b) {
+    emit_mem(b, OP_MOVZX8, REG_P, RDI, -1, offsetof(cpu_state_t, P));
+    emit_ri(b, EXT_AND, REG_P, ~(u32)(P_N | P_V | P_Z | P_C));
+    emit_mem(b, OP_MOVZX8, RAX, RDI, -1, offsetof(cpu_state_t, _c));
+    emit_rr(b, OP_OR, RAX, REG_P);
+    emit_mem(b, OP_MOVZX8, RAX, RDI, -1, offsetof(cpu_state_t, _v));
+    emit_shift(b, EXT_SHL, RAX, 6);
+    emit_rr(b, OP_OR, RAX, REG_P);
+    emit_mem(b, OP_MOVZX8, RAX, RDI, -1, offsetof(cpu_state_t, _n));
+    emit_ri(b, EXT_AND, RAX, P_N);
+    emit_rr(b, OP_OR, RAX, REG_P);
+    emit_mem(b, OP_MOVZX8, RDX, RDI, -1, offsetof(cpu_state_t, _z));
+    emit_rr(b, OP_TEST, RDX, RDX);
+    emit_rr(b, 0x0F94, 0, RAX); // setz
+    emit_rr(b, OP_MOVZX8, RAX, RAX);
+    emit_shift(b, EXT_SHL, RAX, 1);
+    emit_rr(b, OP_OR, RAX, REG_P);
+}
+
+static void emit_store_p(jit_buf_t *b) {
+    emit_mem(b, OP_STORE8, REG_P, RDI, -1, offsetof(cpu_state_t, P));
+    emit_rr(b, OP_MOV, REG_P, RAX);
+    emit_ri(b, EXT_AND, RAX, P_C);
+    emit_mem(b, OP_STORE8, RAX, RDI, -1, offsetof(cpu_state_t, _c));
+    emit_rr(b, OP_MOV, REG_P, RAX);
+    emit_shift(b, EXT_SHR, RAX, 6);
+    emit_ri(b, EXT_AND, RAX, 1);
+    emit_mem(b, OP_STORE8, RAX, RDI, -1, offsetof(cpu_state_t, _v));
+    emit_rr(b, OP_MOV, REG_P, RAX);
+    emit_ri(b, EXT_AND, RAX, P_N);
+    emit_mem(b, OP_STORE8, RAX, RDI, -1, offsetof(cpu_state_t, _n));
+    emit_rr(b, OP_MOV, REG_P, RAX);
+    emit_ri(b, EXT_AND, RAX, P_Z);
+    emit_ri(b, EXT_XOR, RAX, P_Z);
+    emit_mem(b, OP_STORE8, RAX, RDI, -1, offsetof(cpu_state_t, _z));
+}
+
+static void emit_push(jit_buf_t *b, int r) {
+    emit_mem(b, OP_MOVZX8, RCX, RDI, -1, offsetof(cpu_state_t, S));
+    emit_mem(b, OP_STORE8, r, RSI, RCX, 0x100);
+    emit_ri(b, EXT_SUB, RCX, 1);
+    emit_mem(b, OP_STORE8, RCX, RDI, -1, offsetof(cpu_state_t, S));
+}
+
+// pulls into r (not rcx)
+static void emit_pull(jit_buf_t *b, int r) {
+    emit_mem(b, OP_MOVZX8, RCX, RDI, -1, offsetof(cpu_state_t, S));
+    emit_ri(b, EXT_ADD, RCX, 1);
+    emit_ri(b, EXT_AND, RCX, 0xFF);
+    emit_mem(b, OP_STORE8, RCX, RDI, -1, offsetof(cpu_state_t, S));
+    emit_mem(b, OP_MOVZX8, r, RSI, RCX, 0x100);
+}
+
+typedef struct {
+    int base;
+    int index;
+    i32 disp;
+} jit_mem_t;
+
+static int jit_index_reg(cpu_mode_t mode) {
+    return (mode == CPU_MODE_zpy || mode == CPU_MODE_aby) ? REG_Y : REG_X;
+}
+
+// Resolves an operand in internal RAM. The address must be known to stay in
+// RAM for every value of the index register, indexed modes leave the index
+// in rcx
+static bool jit_ram_operand(jit_buf_t *b, cpu_mode_t mode, u16 op, jit_mem_t *m) {
+    switch (mode) {
+        case CPU_MODE_zpg:
+            *m = (jit_mem_t){ RSI, -1, op };
+            return true;
+        case CPU_MODE_zpx:
+        case CPU_MODE_zpy:
+            emit_rr(b, OP_MOV, jit_index_reg(mode), RCX);
+            emit_ri(b, EXT_ADD, RCX, op);
+            emit_ri(b, EXT_AND, RCX, 0xFF);
+            *m = (jit_mem_t){ RSI, RCX, 0 };
+            return true;
+        case CPU_MODE_abs:
+            if (op >= 0x2000) return false;
+            *m = (jit_mem_t){ RSI, -1, op & 0x7FF };
+            return true;
+        case CPU_MODE_abx:
+        case CPU_MODE_aby:
+            if (op + 0xFF >= 0x2000 || (op & 0x7FF) + 0xFF > 0x7FF) return false;
+            emit_rr(b, OP_MOV, jit_index_reg(mode), RCX);
+            *m = (jit_mem_t){ RSI, RCX, op & 0x7FF };
+            return true;
+        default:
+            return false;
+    }
+}
+
+static void emit_page_cross(jit_buf_t *b, cpu_mode_t mode, u16 op) {
+    emit_rr(b, OP_MOV, jit_index_reg(mode), RDX);
+    emit_ri(b, EXT_ADD, RDX, op & 0xFF);
+    emit_shift(b, EXT_SHR, RDX, 8);
+    emit_rr(b, OP_ADD, RDX, RBX);
+}
+
+// loads the operand of a read instruction into eax
+static bool jit_load_operand(jit_t *jit, jit_buf_t *b, cpu_mode_t mode, u16 op, u16 *extra) {
+    jit_mem_t m;
+    const u8 *p;
+    if (mode == CPU_MODE_imm) {
+        emit_mov_ri(b, RAX, op);
+        return true;
+    }
+    if (mode == CPU_MODE_abs && (p = jit->rom_ptr(op)) != NULL) {
+        // the decode cache (and us with it) is flushed on bank switches
+        emit_mov_ri(b, RAX, *p);
+        return true;
+    }
+    if ((mode == CPU_MODE_abx || mode == CPU_MODE_aby) && op <= 0xFF00 &&
+        (p = jit->rom_ptr(op)) != NULL && jit->rom_ptr(op + 0xFF) == p + 0xFF) {
+        emit_rr(b, OP_MOV, jit_index_reg(mode), RCX);
+        emit_mov_ri64(b, RAX, (u64)(uintptr_t)p);
+        emit_mem(b, OP_MOVZX8, RAX, RAX, RCX, 0);
+        emit_page_cross(b, mode, op);
+        (*extra)++;
+        return true;
+    }
+    if (!jit_ram_operand(b, mode, op, &m)) return false;
+    emit_mem(b, OP_MOVZX8, RAX, m.base, m.index, m.disp);
+    if (mode == CPU_MODE_abx || mode == CPU_MODE_aby) {
+        emit_page_cross(b, mode, op);
+        (*extra)++;
+    }
+    return true;
+}
+
+static void emit_adc(jit_buf_t *b) {
+    // edx = A + M + C, V = (M^res) & (A^res) & 0x80
+    emit_rr(b, OP_MOV, REG_P, RDX);
+    emit_ri(b, EXT_AND, RDX, P_C);
+    emit_rr(b, OP_ADD, RAX, RDX);
+    emit_rr(b, OP_ADD, REG_A, RDX);
+    emit_rr(b, OP_MOV, REG_A, RCX);
+    emit_rr(b, OP_XOR, RDX, RAX);
+    emit_rr(b, OP_XOR, RDX, RCX);
+    emit_rr(b, OP_AND, RCX, RAX);
+    emit_ri(b, EXT_AND, RAX, 0x80);
+    emit_shift(b, EXT_SHR, RAX, 1);
+    emit_ri(b, EXT_AND, REG_P, ~(u32)(P_V | P_C));
+    emit_rr(b, OP_OR, RAX, REG_P);
+    emit_rr(b, OP_MOV, RDX, RAX);
+    emit_shift(b, EXT_SHR, RAX, 8);
+    emit_rr(b, OP_OR, RAX, REG_P);
+    emit_ri(b, EXT_AND, RDX, 0xFF);
+    emit_rr(b, OP_MOV, RDX, REG_A);
+    emit_set_nz(b, REG_A, RAX);
+}
+
+static void emit_cmp(jit_buf_t *b, int r) {
+    // C = (M <= r), i.e. no borrow out of bit 8
+    emit_rr(b, OP_MOV, r, RDX);
+    emit_rr(b, OP_SUB, RAX, RDX);
+    emit_rr(b, OP_MOV, RDX, RAX);
+    emit_shift(b, EXT_SHR, RAX, 8);
+    emit_ri(b, EXT_AND, RAX, 1);
+    emit_ri(b, EXT_XOR, RAX, 1);
+    emit_set_c(b, RAX);
+    emit_ri(b, EXT_AND, RDX, 0xFF);
+    emit_set_nz(b, RDX, RAX);
+}
+
+static bool jit_read(jit_buf_t *b, cpu_mnemonic_t mn) {
+    switch (mn) {
+        case CPU_LDA: emit_rr(b, OP_MOV, RAX, REG_A); emit_set_nz(b, REG_A, RAX); break;
+        case CPU_LDX: emit_rr(b, OP_MOV, RAX, REG_X); emit_set_nz(b, REG_X, RAX); break;
+        case CPU_LDY: emit_rr(b, OP_MOV, RAX, REG_Y); emit_set_nz(b, REG_Y, RAX); break;
+        case CPU_ORA: emit_rr(b, OP_OR, RAX, REG_A); emit_set_nz(b, REG_A, RAX); break;
+        case CPU_AND: emit_rr(b, OP_AND, RAX, REG_A); emit_set_nz(b, REG_A, RAX); break;
+        case CPU_EOR: emit_rr(b, OP_XOR, RAX, REG_A); emit_set_nz(b, REG_A, RAX); break;
+        case CPU_ADC: emit_adc(b); break;
+        case CPU_SBC: emit_ri(b, EXT_XOR, RAX, 0xFF); emit_adc(b); break;
+        case CPU_CMP: emit_cmp(b, REG_A); break;
+        case CPU_CPX: emit_cmp(b, REG_X); break;
+        case CPU_CPY: emit_cmp(b, REG_Y); break;
+        case CPU_BIT:
+            emit_ri(b, EXT_AND, REG_P, ~(u32)(P_N | P_V | P_Z));
+            emit_rr(b, OP_MOV, RAX, RDX);
+            emit_ri(b, EXT_AND, RDX, P_N | P_V);
+            emit_rr(b, OP_OR, RDX, REG_P);
+            emit_rr(b, OP_TEST, REG_A, RAX);
+            emit_rr(b, 0x0F94, 0, RDX); // setz
+            emit_rr(b, OP_MOVZX8, RDX, RDX);
+            emit_shift(b, EXT_SHL, RDX, 1);
+            emit_rr(b, OP_OR, RDX, REG_P);
+            break;
+        default: return false;
+    }
+    return true;
+}
+
+// operates on eax, leaves ecx alone
+static bool jit_rmw(jit_buf_t *b, cpu_mnemonic_t mn) {
+    switch (mn) {
+        case CPU_ASL:
+            emit_rr(b, OP_MOV, RAX, RDX);
+            emit_shift(b, EXT_SHR, RDX, 7);
+            emit_set_c(b, RDX);
+            emit_shift(b, EXT_SHL, RAX, 1);
+            break;
+        case CPU_LSR:
+            emit_rr(b, OP_MOV, RAX, RDX);
+            emit_ri(b, EXT_AND, RDX, 1);
+            emit_set_c(b, RDX);
+            emit_shift(b, EXT_SHR, RAX, 1);
+            break;
+        case CPU_ROL:
+            emit_shift(b, EXT_SHL, RAX, 1);
+            emit_rr(b, OP_MOV, REG_P, RDX);
+            emit_ri(b, EXT_AND, RDX, P_C);
+            emit_rr(b, OP_OR, RDX, RAX);
+            emit_rr(b, OP_MOV, RAX, RDX);
+            emit_shift(b, EXT_SHR, RDX, 8);
+            emit_set_c(b, RDX);
+            break;
+        case CPU_ROR:
+            emit_rr(b, OP_MOV, REG_P, RDX);
+            emit_ri(b, EXT_AND, RDX, P_C);
+            emit_shift(b, EXT_SHL, RDX, 8);
+            emit_rr(b, OP_OR, RDX, RAX);
+            emit_rr(b, OP_MOV, RAX, RDX);
+            emit_ri(b, EXT_AND, RDX, 1);
+            emit_set_c(b, RDX);
+            emit_shift(b, EXT_SHR, RAX, 1);
+            break;
+        case CPU_INC: emit_ri(b, EXT_ADD, RAX, 1); break;
+        case CPU_DEC: emit_ri(b, EXT_SUB, RAX, 1); break;
+        default: return false;
+    }
+    emit_ri(b, EXT_AND, RAX, 0xFF);
+    emit_set_nz(b, RAX, RDX);
+    return true;
+}
+
+static void emit_transfer(jit_buf_t *b, int src, int dst) {
+    emit_rr(b, OP_MOV, src, dst);
+    emit_set_nz(b, dst, RAX);
+}
+
+static void emit_step(jit_buf_t *b, int r, int ext) {
+    emit_ri(b, ext, r, 1);
+    emit_ri(b, EXT_AND, r, 0xFF);
+    emit_set_nz(b, r, RAX);
+}
+
+// implied instructions that don't end the block
+static bool jit_implied(jit_buf_t *b, cpu_mnemonic_t mn) {
+    switch (mn) {
+        case CPU_TAX: emit_transfer(b, REG_A, REG_X); break;
+        case CPU_TAY: emit_transfer(b, REG_A, REG_Y); break;
+        case CPU_TXA: emit_transfer(b, REG_X, REG_A); break;
+        case CPU_TYA: emit_transfer(b, REG_Y, REG_A); break;
+        case CPU_TSX:
+            emit_mem(b, OP_MOVZX8, REG_X, RDI, -1, offsetof(cpu_state_t, S));
+            emit_set_nz(b, REG_X, RAX);
+            break;
+        case CPU_TXS: emit_mem(b, OP_STORE8, REG_X, RDI, -1, offsetof(cpu_state_t, S)); break;
+        case CPU_INX: emit_step(b, REG_X, EXT_ADD); break;
+        case CPU_INY: emit_step(b, REG_Y, EXT_ADD); break;
+        case CPU_DEX: emit_step(b, REG_X, EXT_SUB); break;
+        case CPU_DEY: emit_step(b, REG_Y, EXT_SUB); break;
+        case CPU_CLC: emit_ri(b, EXT_AND, REG_P, ~(u32)P_C); break;
+        case CPU_SEC: emit_ri(b, EXT_OR, REG_P, P_C); break;
+        case CPU_CLD: emit_ri(b, EXT_AND, REG_P, ~(u32)P_D); break;
+        case CPU_SED: emit_ri(b, EXT_OR, REG_P, P_D); break;
+        case CPU_CLV: emit_ri(b, EXT_AND, REG_P, ~(u32)P_V); break;
+        case CPU_NOP: break;
+        case CPU_PHA: emit_push(b, REG_A); break;
+        case CPU_PHP: emit_push(b, REG_P); break;
+        case CPU_PLA: emit_pull(b, REG_A); emit_set_nz(b, REG_A, RAX); break;
+        // PLP, CLI, SEI change I and can unmask a pending IRQ, BRK and RTI
+        // are interrupts of their own
+        default: return false;
+    }
+    return true;
+}
+
+static bool jit_branch_taken_on_set(cpu_mnemonic_t mn, u32 *mask) {
+    switch (mn) {
+        case CPU_BPL: *mask = P_N; return false;
+        case CPU_BMI: *mask = P_N; return true;
+        case CPU_BVC: *mask = P_V; return false;
+        case CPU_BVS: *mask = P_V; return true;
+        case CPU_BCC: *mask = P_C; return false;
+        case CPU_BCS: *mask = P_C; return true;
+        case CPU_BNE: *mask = P_Z; return false;
+        default:      *mask = P_Z; return true; // BEQ
+    }
+}
+
+// Translates the decoded block at idx. Each instruction either fits or the
+// whole block is given up on
+static bool jit_translate(jit_t *jit, cpu_state_t *st, u32 idx, jit_block_t *blk) {
+    cpu_decode_cache_t *dc = st->decode_cache;
+    const cpu_decoded_t *d = &dc->entries[idx];
+    u32 n = d->block_len;
+    size_t need = n * JIT_MAX_INSTR_BYTES + 64;
+    if (jit->code_used + need > jit->code_size) jit_flush(jit);
+
+    jit_buf_t buf = { jit->code + jit->code_used, jit->code + jit->code_size, false };
+    jit_buf_t *b = &buf;
+    u8 *start = b->p;
+    u16 pc = dc->base + idx;
+    u32 cycles = 0;
+    u16 extra = 0;
+    bool pc_set = false;
+
+    emit8(b, 0x53); // push rbx
+    emit_rr(b, OP_XOR, RBX, RBX);
+    emit_mem(b, OP_MOVZX8, REG_A, RDI, -1, offsetof(cpu_state_t, A));
+    emit_mem(b, OP_MOVZX8, REG_X, RDI, -1, offsetof(cpu_state_t, X));
+    emit_mem(b, OP_MOVZX8, REG_Y, RDI, -1, offsetof(cpu_state_t, Y));
+    emit_load_p(b);
+
+    for (u32 i=0; i<n; i++) {
+        cpu_opcode_t info = cpu_opcodes[d->opcode];
+        u16 op = d->operand;
+        u16 next = pc + d->length;
+        jit_mem_t m;
+        if (info.mnemonic == CPU_ILL) return false;
+        cycles += info.cycles;
+
+        switch (info.kind) {
+            case CPU_KIND_read:
+                if (!jit_load_operand(jit, b, info.mode, op, &extra)) return false;
+                if (!jit_read(b, info.mnemonic)) return false;
+                break;
+            case CPU_KIND_rmw:
+                if (info.mode == CPU_MODE_acc) {
+                    emit_rr(b, OP_MOV, REG_A, RAX);
+                    if (!jit_rmw(b, info.mnemonic)) return false;
+                    emit_rr(b, OP_MOV, RAX, REG_A);
+                    break;
+                }
+                if (!jit_ram_operand(b, info.mode, op, &m)) return false;
+                emit_mem(b, OP_MOVZX8, RAX, m.base, m.index, m.disp);
+                if (!jit_rmw(b, info.mnemonic)) return false;
+                emit_mem(b, OP_STORE8, RAX, m.base, m.index, m.disp);
+                break;
+            case CPU_KIND_write: {
+                int r = info.mnemonic == CPU_STA ? REG_A : info.mnemonic == CPU_STX ? REG_X : REG_Y;
+                if (!jit_ram_operand(b, info.mode, op, &m)) return false;
+                emit_mem(b, OP_STORE8, r, m.base, m.index, m.disp);
+                break;
+            }
+            case CPU_KIND_all:
+                if (info.mnemonic == CPU_RTS) {
+                    // PC = pulled address + 1
+                    emit_pull(b, RAX);
+                    emit_pull(b, RDX);
+                    emit_shift(b, EXT_SHL, RDX, 8);
+                    emit_rr(b, OP_OR, RDX, RAX);
+                    emit_ri(b, EXT_ADD, RAX, 1);
+                    emit_store16(b, RAX, RDI, offsetof(cpu_state_t, PC));
+                    pc_set = true;
+                    break;
+                }
+                if (!jit_implied(b, info.mnemonic)) return false;
+                break;
+            case CPU_KIND_branch: {
+                u16 target = next + (s8)op;
+                u32 mask;
+                bool on_set = jit_branch_taken_on_set(info.mnemonic, &mask);
+                emit_mov_ri(b, RAX, next);
+                emit_test_ri(b, REG_P, mask);
+                u8 *skip = emit_jcc(b, on_set ? CC_Z : CC_NZ);
+                emit_mov_ri(b, RAX, target);
+                emit_ri(b, EXT_ADD, RBX, ((next & 0xFF00) != (target & 0xFF00)) ? 2 : 1);
+                jit_patch(b, skip);
+                emit_store16(b, RAX, RDI, offsetof(cpu_state_t, PC));
+                extra += 2;
+                pc_set = true;
+                break;
+            }
+            case CPU_KIND_jmp:
+                if (info.mode != CPU_MODE_abs) return false;
+                emit_mov_ri(b, RAX, op);
+                emit_store16(b, RAX, RDI, offsetof(cpu_state_t, PC));
+                pc_set = true;
+                break;
+            case CPU_KIND_jsr:
+                // pushes the address of the operand's high byte
+                emit_mov_ri(b, RAX, (u16)(next - 1) >> 8);
+                emit_push(b, RAX);
+                emit_mov_ri(b, RAX, (next - 1) & 0xFF);
+                emit_push(b, RAX);
+                emit_mov_ri(b, RAX, op);
+                emit_store16(b, RAX, RDI, offsetof(cpu_state_t, PC));
+                pc_set = true;
+                break;
+        }
+
+        pc = next;
+        if (i + 1 < n) d = &dc->entries[pc - dc->base];
+    }
+
+    if (!pc_set) {
+        emit_mov_ri(b, RAX, pc);
+        emit_store16(b, RAX, RDI, offsetof(cpu_state_t, PC));
+    }
+    emit_mem(b, OP_STORE8, REG_A, RDI, -1, offsetof(cpu_state_t, A));
+    emit_mem(b, OP_STORE8, REG_X, RDI, -1, offsetof(cpu_state_t, X));
+    emit_mem(b, OP_STORE8, REG_Y, RDI, -1, offsetof(cpu_state_t, Y));
+    emit_store_p(b);
+    emit_rr(b, OP_MOV, RBX, RAX);
+    emit_ri(b, EXT_ADD, RAX, cycles);
+    emit8(b, 0x5B); // pop rbx
+    emit8(b, 0xC3); // ret
+
+    if (b->overflow || cycles + extra > 0xFFFF) return false;
+
+    blk->code = start;
+    blk->max_cycles = cycles + extra;
+    jit->code_used = b->p - jit->code;
+    jit->blocks_translated++;
+    return true;
+}
+
+// The code buffer is never writable and executable at once: writable only
+// while a block is emitted, executable otherwise
+static bool jit_protect(jit_t *jit, bool writable) {
+    if (mprotect(jit->code, jit->code_size, PROT_READ | (writable ? PROT_WRITE : PROT_EXEC)) == 0) return true;
+    if (!writable) {
+        log_fatal("Could not make JIT code executable: %s", strerror(errno));
+        exit(1);
+    }
+    log_warn("Could not make JIT code writable: %s", strerror(errno));
+    return false;
+}
+
+bool jit_init(cpu_state_t *st, u8 *ram, const u8 *(*rom_ptr)(u16), u32 (*cycles_to_event)(void)) {
+    if (st->decode_cache == NULL) {
+        log_warn("JIT needs the decode cache, using the interpreter");
+        return false;
+    }
+    jit_t *jit = calloc(1, sizeof(jit_t));
+    jit_block_t *blocks = calloc(st->decode_cache->size, sizeof(jit_block_t));
+    void *code = mmap(NULL, JIT_CODE_SIZE, PROT_READ | PROT_WRITE,
+                      MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (jit == NULL || blocks == NULL || code == MAP_FAILED) {
+        log_warn("Could not set up the JIT, using the interpreter");
+        free(jit);
+        free(blocks);
+        if (code != MAP_FAILED) munmap(code, JIT_CODE_SIZE);
+        return false;
+    }
+    *jit = (jit_t){
+        .ram = ram,
+        .rom_ptr = rom_ptr,
+        .cycles_to_event = cycles_to_event,
+        .code = code,
+        .code_size = JIT_CODE_SIZE,
+        .blocks = blocks,
+        .num_blocks = st->decode_cache->size
+    };
+    st->jit = jit;
+    return true;
+}
+
+void jit_flush(jit_t *jit) {
+    memset(jit->blocks, 0, jit->num_blocks * sizeof(jit_block_t));
+    jit->code_used = 0;
+}
+
+void jit_free(cpu_state_t *st) {
+    jit_t *jit = st->jit;
+    if (jit == NULL) return;
+    munmap(jit->code, jit->code_size);
+    free(jit->blocks);
+    free(jit);
+    st->jit = NULL;
+}
+
+int jit_exec(cpu_state_t *st) {
+    jit_t *jit = st->jit;
+    cpu_decode_cache_t *dc = st->decode_cache;
+    if (st->PC < dc->base || (u32)(st->PC - dc->base) >= dc->size) return 0;
+
+    u32 idx = st->PC - dc->base;
+    jit_block_t *blk = &jit->blocks[idx];
+    if (blk->code == NULL) {
+        if (blk->failed || dc->entries[idx].block_len == 0) return 0;
+        if (++blk->hits < JIT_HOT_THRESHOLD) return 0;
+        bool ok = jit_protect(jit, true) && jit_translate(jit, st, idx, blk);
+        jit_protect(jit, false);
+        if (!ok) {
+            blk->failed = true;
+            return 0;
+        }
+    }
+    if (blk->max_cycles > jit->cycles_to_event()) return 0;
+
+    jit->blocks_run++;
+    return ((jit_fn_t)blk->code)(st, jit->ram);
+}
+
+#else
+
+bool jit_init(cpu_state_t *st, u8 *ram, const u8 *(*rom_ptr)(u16), u32 (*cycles_to_event)(void)) {
+    log_warn("JIT is only supported on x86-64, using the interpreter");
+    return false;
+}
+
+void jit_flush(jit_t *jit) {}
+void jit_free(cpu_state_t *st) {}
+int jit_exec(cpu_state_t *st) { return 0; }
+
+#endif
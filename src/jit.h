@@ -0,0 +1,47 @@
+// SPDX-License-Identifier: GPL-3.0-or-later
+// Copyright 2024 neov5
+
+#ifndef __JIT_H__
+#define __JIT_H__
+
+#include <stdbool.h>
+#include <stddef.h>
+
+#include "types.h"
+#include "cpu.h"
+
+// Translates hot basic blocks from the decode cache into x86-64 code. A
+// translated block runs without ticking and the cycles are ticked in one go
+// when it returns, so it's only entered when no cycle-sensitive event can
+// happen before it's done. Blocks touching anything but internal RAM and
+// PRG-ROM are left to the interpreter.
+
+typedef struct {
+    u8 *code; // NULL if not translated (yet)
+    u16 hits;
+    u16 max_cycles; // upper bound including page crossings and taken branches
+    bool failed; // block can't be translated, don't try again
+} jit_block_t;
+
+typedef struct jit_t {
+    u8 *ram; // 2 KiB internal RAM, mirrored up to $1FFF
+    const u8 *(*rom_ptr)(u16 addr); // PRG-ROM byte behind addr, NULL if none
+    u32 (*cycles_to_event)(void); // cpu cycles a block can run uninterrupted
+
+    u8 *code;
+    size_t code_size;
+    size_t code_used;
+
+    jit_block_t *blocks; // indexed like the decode cache entries
+    u32 num_blocks;
+
+    u64 blocks_translated;
+    u64 blocks_run;
+} jit_t;
+
+bool jit_init(cpu_state_t *st, u8 *ram, const u8 *(*rom_ptr)(u16), u32 (*cycles_to_event)(void));
+void jit_flush(jit_t *jit);
+void jit_free(cpu_state_t *st);
+int jit_exec(cpu_state_t *st);
+
+#endif
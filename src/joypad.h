@@ -24,7 +24,6 @@ typedef struct {
     bool strobe;
 } joypad_t;
 
-void joypad_update(joypad_t *joypad);
 void joypad_write(joypad_t *joypad, u8 data);
 u8 joypad_read(joypad_t *joypad);
 
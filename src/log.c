@@ -44,13 +44,13 @@ static void _log_event(log_event_t *ev) {
     else {
         fprintf(
             ev->output, "(cpu: %-8llu) (ppu: %-8llu) %-5s ",
-            state.cpu_cycle, state.ppu_cycle, 
+            state.cpu_st.cycles, state.ppu_cycle, 
             level_strings[ev->level]);
     }
 #else
     fprintf(
         ev->output, "(cpu: %-8llu) (ppu: %-8llu) %-5s ",
-        state.cpu_cycle, state.ppu_cycle, 
+        state.cpu_st.cycles, state.ppu_cycle, 
         level_strings[ev->level]);
 #endif
     vfprintf(ev->output, ev->fmt, ev->ap);
@@ -61,7 +61,7 @@ static void _log_event(log_event_t *ev) {
 void log_log(log_level_t level, const char* fmt, ...) {
     log_event_t evt = {
         .fmt   = fmt,
-        .cpu_cycle = state.cpu_cycle,
+        .cpu_cycle = state.cpu_st.cycles,
         .ppu_cycle = state.ppu_cycle,
         .output = stderr,
         .level = level,
@@ -2,19 +2,133 @@
 // Copyright 2024 neov5
 
 #include "nes.h"
+#include "disp.h"
 #include "log.h"
+#include "pace.h"
 #include "parse_args.h"
+#include "rewind.h"
+#include <errno.h>
 #include <stdio.h>
-#include <time.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef NES_HEADLESS
+#define DISPLAYS "null"
+#else
+#define DISPLAYS "sdl|null"
+#endif
+
+extern nes_state_t state;
+
+static FILE *open_output(const char *path) {
+    FILE *f = fopen(path, "w");
+    if (f == NULL) {
+        log_fatal("Could not open %s for writing: %s", path, strerror(errno));
+        exit(1);
+    }
+    return f;
+}
+
+// the joypad state of every frame and the hash of what it drew, one per line
+// in hex, for brightnes-bench to replay and check against
+static FILE *record_file;
+static FILE *hashes_file;
+static unsigned long frame;
+
+static void run_frame(bool drawn, u32 run_ahead) {
+    if (record_file) fprintf(record_file, "%02x\n", state.joypad.state);
+    if (drawn) nes_render_frame_ahead(run_ahead);
+    else {
+        disp_suppress(true);
+        nes_render_frame();
+        disp_suppress(false);
+    }
+    if (hashes_file) fprintf(hashes_file, "%016" PRIx64 "\n", disp_frame_hash());
+    frame++;
+}
+
+// what the emulation loop needs from the command line
+typedef struct {
+    unsigned long frames;
+    u32 run_ahead;
+    bool fast_forward;
+    u32 ff_speed;
+    bool rewind_on;
+    rewind_t rw;
+    bool paced;
+    pace_t pace;
+} emu_t;
+
+// on a thread of its own when the display keeps the main one, see disp_run
+static void emulate(void *arg) {
+    emu_t *emu = arg;
+    bool exit = false;
+    u8 hotkeys = 0;
+    u64 draw_cost = 0; // of the last drawn frame
+    while (!exit) {
+        exit = nes_update_events(&hotkeys);
+        // while rewinding, frames are played from the history instead of
+        // going into it
+        if (emu->rewind_on && !((hotkeys & DISP_KEY_REWIND) && rewind_pop(&emu->rw))) rewind_push(&emu->rw);
+
+        // fast-forward runs ff_speed frames per frame shown, or as many as
+        // fit in one (0) with room left for the drawn one. Only the last is
+        // drawn, unless all are hashed
+        if (emu->fast_forward || (hotkeys & DISP_KEY_FAST_FORWARD)) {
+            u64 t = pace_now(), cost = 0;
+            for (u32 i = 1; emu->ff_speed ? i < emu->ff_speed : pace_left(&emu->pace) > (i64)(cost + draw_cost); i++) {
+                if (emu->frames && frame >= emu->frames) break;
+                run_frame(hashes_file != NULL, 0);
+                cost = pace_now() - t;
+                t += cost;
+            }
+        }
+        if (!emu->frames || frame < emu->frames) {
+            u64 t = pace_now();
+            run_frame(true, emu->run_ahead);
+            draw_cost = pace_now() - t;
+        }
+        if (emu->frames && frame >= emu->frames) exit = true;
+        pace_wait(&emu->pace, emu->paced);
+    }
+}
 
 int main(int argc, char** argv) {
 
     char *palette_path = NULL;
     char *rom_path = NULL;
+    char *cpu_backend = NULL;
+    char *display = NULL;
+    unsigned long frames = 0;
+    char *record_path = NULL;
+    char *hashes_path = NULL;
+    unsigned long rewind_mb = 0;
+    unsigned int run_ahead = 0;
+    int fast_forward = 0;
+    unsigned int ff_speed = 0;
+    int vsync = 0;
+    unsigned int spin_us = 0;
+    int stats = 0;
+    char *scale = NULL;
+    char *ppu_renderer = NULL;
 
     args_option_t options[] = {
         ARGS_POSITIONAL_ARG(ARGTYPE_STRING, &rom_path),
         ARGS_OPTION("-p", "--palette", ARGTYPE_STRING, &palette_path),
+        ARGS_OPTION("-c", "--cpu", ARGTYPE_STRING, &cpu_backend),
+        ARGS_OPTION("-d", "--display", ARGTYPE_STRING, &display),
+        ARGS_OPTION("-n", "--frames", ARGTYPE_ULONG, &frames),
+        ARGS_OPTION("-r", "--record", ARGTYPE_STRING, &record_path),
+        ARGS_OPTION("-H", "--hashes", ARGTYPE_STRING, &hashes_path),
+        ARGS_OPTION("-R", "--rewind", ARGTYPE_ULONG, &rewind_mb),
+        ARGS_OPTION("-a", "--run-ahead", ARGTYPE_UINT, &run_ahead),
+        ARGS_FLAG("-f", "--fast-forward", &fast_forward),
+        ARGS_OPTION("-F", "--ff-speed", ARGTYPE_UINT, &ff_speed),
+        ARGS_FLAG("-V", "--vsync", &vsync),
+        ARGS_OPTION("-S", "--spin", ARGTYPE_UINT, &spin_us),
+        ARGS_FLAG("-s", "--stats", &stats),
+        ARGS_OPTION("-x", "--scale", ARGTYPE_STRING, &scale),
+        ARGS_OPTION("-P", "--ppu", ARGTYPE_STRING, &ppu_renderer),
         ARGS_END_OF_OPTIONS
     };
 
@@ -22,8 +136,21 @@ int main(int argc, char** argv) {
     log_add_fp(fopen("build/debug/brightnes.log", "w"));
 #endif
 
-    if (parse_arguments(argc, argv, options) < 0) {
-        printf("usage: brightnes <rom_path> [-p|--palette palette_path]\n");
+    // frames shown with run-ahead come from a made up future, recordings of
+    // them could never be replayed by brightnes-bench
+    if (parse_arguments(argc, argv, options) < 0 ||
+        (run_ahead && (record_path != NULL || hashes_path != NULL)) ||
+        (cpu_backend != NULL && strcmp(cpu_backend, "interp") && strcmp(cpu_backend, "jit")) ||
+        (display != NULL && !disp_set_backend(display)) ||
+        (scale != NULL && strcmp(scale, "integer") && strcmp(scale, "fit") && strcmp(scale, "ntsc")) ||
+        (ppu_renderer != NULL && strcmp(ppu_renderer, "auto") && strcmp(ppu_renderer, "dot") &&
+         strcmp(ppu_renderer, "scanline"))) {
+        printf("usage: brightnes <rom_path> [-p|--palette palette_path] [-c|--cpu interp|jit] "
+               "[-d|--display " DISPLAYS "] [-n|--frames count] [-r|--record input_path] "
+               "[-H|--hashes hashes_path] [-R|--rewind megabytes] "
+               "[-a|--run-ahead frames] [-f|--fast-forward] [-F|--ff-speed speed] "
+               "[-V|--vsync] [-S|--spin microseconds] [-s|--stats] [-x|--scale integer|fit|ntsc] "
+               "[-P|--ppu auto|dot|scanline]\n");
         return 0;
     }
 
@@ -31,28 +158,44 @@ int main(int argc, char** argv) {
         nes_load_palette(palette_path);
     }
 
-    nes_init(argv[1]);
+    nes_init(rom_path);
+    if (cpu_backend != NULL && strcmp(cpu_backend, "jit") == 0) {
+        nes_set_cpu_backend(NES_CPU_JIT);
+    }
 
+    if (ppu_renderer != NULL && strcmp(ppu_renderer, "dot") == 0) ppu_set_renderer(PPU_RENDER_DOT);
+    if (ppu_renderer != NULL && strcmp(ppu_renderer, "scanline") == 0) ppu_set_renderer(PPU_RENDER_SCANLINE);
+    if (scale != NULL && strcmp(scale, "fit") == 0) disp_set_scale(DISP_SCALE_FIT);
+    if (scale != NULL && strcmp(scale, "ntsc") == 0) disp_set_scale(DISP_SCALE_NTSC);
 
-    bool exit = false;
-    struct timespec tic, toc;
-    timespec_get(&tic, TIME_UTC);
-    while (!exit) {
-        exit = nes_update_events();
-        nes_render_frame();
-#ifndef NES_DEBUG
-        timespec_get(&toc, TIME_UTC);
-        // 60fps
-        long long ns_delta = toc.tv_nsec - tic.tv_nsec;
-        if (toc.tv_sec - tic.tv_sec == 0 && ns_delta < 16666666LL) {
-            // log_warn("Sleeping for %lld nanos", 16666666LL-ns_delta);
-            nanosleep((struct timespec[]){{0, 16666666LL-ns_delta}}, NULL);
-        }
-        timespec_get(&tic, TIME_UTC);
+    if (record_path) record_file = open_output(record_path);
+    if (hashes_path) hashes_file = open_output(hashes_path);
+    disp_hash_frames(hashes_file != NULL);
+
+    emu_t emu = { .frames = frames, .run_ahead = run_ahead, .fast_forward = fast_forward, .ff_speed = ff_speed };
+    emu.rewind_on = rewind_mb && rewind_init(&emu.rw, rewind_mb << 20, REWIND_KEY_INTERVAL);
+
+    // nothing to watch without a window, run as fast as we can. With vsync
+    // the screen paces instead
+    emu.paced = strcmp(disp_name(), "null") != 0;
+    if (vsync && !disp_set_vsync(true)) log_warn("%s display can't vsync, pacing with the timer", disp_name());
+    else if (vsync) emu.paced = false;
+#ifdef NES_DEBUG
+    emu.paced = false;
 #endif
-    }
 
+    pace_init(&emu.pace, spin_us * 1000ULL);
+    disp_run(emulate, &emu);
+
+    if (record_file) fclose(record_file);
+    if (hashes_file) fclose(hashes_file);
+    if (emu.rewind_on) rewind_free(&emu.rw);
     nes_exit();
 
+    if (stats) {
+        pace_print_stats(&emu.pace, stdout);
+        disp_print_stats(stdout);
+    }
+
     return 0;
 }
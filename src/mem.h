@@ -11,6 +11,10 @@ typedef struct {
     u8 wram[0x800];
     u8 apu_io_reg[0x20];
 
+    // what the cpu sees in each 256 byte page, NULL for I/O
+    u8 *read_pages[0x100];
+    u8 *write_pages[0x100];
+
 } mem_cpu_t;
 
 typedef struct {
@@ -4,8 +4,14 @@
 #include "nes.h"
 #include "log.h"
 #include "dma.h"
+#include "jit.h"
+#include "sched.h"
+#include "disp.h"
+#include "savestate.h"
 #include <errno.h>
-#include <SDL2/SDL.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
 
 nes_state_t state;
 
@@ -27,11 +33,29 @@ u8 palette_memory[192] = {
 
 static char ppu_state_buf[128];
 static char cpu_state_buf[64];
+static char disasm_buf[32];
+
+// Points the cpu page tables at internal RAM and the mapper's PRG pages. The
+// rest ($2000-$40FF, writes outside of RAM) goes through the bus handlers
+void nes_map_cpu_pages() {
+    mem_cpu_t *mem = &state.cpu_mem;
+    for (int i=0; i<0x100; i++) {
+        mem->read_pages[i] = mem->write_pages[i] = NULL;
+    }
+    for (int i=0; i<0x20; i++) {
+        mem->read_pages[i] = mem->write_pages[i] = &mem->wram[(i << 8) & 0x7FF];
+    }
+    // $4100-$7FFF read the ROM the way the mapper does (addr & 0x7FFF)
+    for (int i=0x41; i<0x100; i++) {
+        mem->read_pages[i] = state.rom.prg_pages[i & 0x7F];
+    }
+}
 
 u8 nes_cpu_bus_read(u16 addr) {
     if (addr < 0x2000) return state.cpu_mem.wram[addr & 0x7FF];
     else if (addr < 0x4000) {
         u16 eaddr = addr & 0x7;
+        nes_ppu_catch_up();
         switch (eaddr) {
             case 2: return ppu_ppustatus_read(&state.ppu_st);
             case 4: return ppu_oamdata_read(&state.ppu_st);
@@ -72,6 +96,7 @@ void nes_cpu_bus_write(u8 data, u16 addr) {
     if (addr < 0x2000) state.cpu_mem.wram[addr & 0x7FF] = data;
     else if (addr < 0x4000) {
         u16 eaddr = addr & 0x7;
+        nes_ppu_catch_up();
         switch (eaddr) {
             case 0: ppu_ppuctrl_write(&state.ppu_st, data); break;
             case 1: ppu_ppumask_write(&state.ppu_st, data); break;
@@ -86,8 +111,8 @@ void nes_cpu_bus_write(u8 data, u16 addr) {
     else if (addr < 0x4020) {
         switch (addr) {
             case 0x4014:
-                state.dma_oam.enabled = true;
                 state.dma_oam.addr = data;
+                sched_set(&state.sched, SCHED_DMA, state.cpu_st.cycles);
                 break;
             case 0x4016: 
                 joypad_write(&state.joypad, data);
@@ -96,7 +121,17 @@ void nes_cpu_bus_write(u8 data, u16 addr) {
                 state.cpu_mem.apu_io_reg[addr & 0x3F] = data;
         }
     }
-    else state.rom.mapper.cpu_write(&state.rom, data, addr & 0x7FFF);
+    else {
+        // the ppu reads CHR through the mapper
+        nes_ppu_catch_up();
+        state.rom.mapper.cpu_write(&state.rom, data, addr & 0x7FFF);
+        // mapper registers can switch the PRG bank under the page tables and
+        // the decode cache
+        if (state.rom.mapper.type != NONE) {
+            nes_map_cpu_pages();
+            cpu_decode_cache_flush(&state.cpu_st);
+        }
+    }
 }
 
 void nes_ppu_bus_write(u8 data, u16 addr) {
@@ -115,32 +150,103 @@ void nes_ppu_bus_write(u8 data, u16 addr) {
     else ppu_palette_ram_write(&state.ppu_st, addr & 0x1F, data);
 }
 
-void nes_cpu_tick_callback() {
-    // TODO loop unroll hinting via pragmas for GCC/clang
-    state.cpu_cycle++;
-    for (int i=0; i<3; i++) {
-        ppu_tick(&state.ppu_st, &state.cpu_st);
-        state.ppu_cycle++;
-        if (state.ppu_cycle % 1000 == 0) {
+// PRG-ROM byte the cpu sees at addr, for the JIT to read ROM directly
+static const u8 *nes_prg_rom_ptr(u16 addr) {
+    if (addr < 0x8000 || state.rom.mapper.type != NONE) return NULL;
+    return &state.rom.prg_rom[(addr & 0x7FFF) % state.rom.prg_rom_size];
+}
+
+// cpu cycle on which the caught up ppu reaches (row, col)
+static u64 nes_ppu_cycle_at(i32 row, i32 col) {
+    i32 dot = state.ppu_st._row*341 + state.ppu_st._col - state.ppu_st._dots_ahead;
+    i32 left = row*341 + col - dot;
+    if (left <= 0) left += 262*341 - 1; // one dot less on odd frames
+    return state.cpu_cycle + (left + 2) / 3;
+}
+
+// Runs the ppu up to the cpu's cycle count. Register accesses, DMA and mapper
+// writes catch up on their own, the scheduler does when a ppu event is due
+void nes_ppu_catch_up() {
+    if (state.cpu_cycle < state.cpu_st.cycles) {
+        u64 dots = 3 * (state.cpu_st.cycles - state.cpu_cycle);
+        ppu_run(&state.ppu_st, &state.cpu_st, dots);
+        state.cpu_cycle = state.cpu_st.cycles;
+        state.ppu_cycle += dots;
+    }
+    // a frame finished by a register access still has to stop the frame loop
+    sched_set(&state.sched, SCHED_VBLANK_START,
+              state.frame_done ? state.cpu_cycle : nes_ppu_cycle_at(241, 1));
+    sched_set(&state.sched, SCHED_NMI, nes_ppu_cycle_at(241, 4));
+    sched_set(&state.sched, SCHED_VBLANK_END, nes_ppu_cycle_at(261, 1));
+}
+
+// cpu cycles that can run before the next event
+static u32 nes_cpu_cycles_to_event() {
+    if (state.cpu_st.cycles >= state.sched.next) return 0;
+    u64 left = state.sched.next - state.cpu_st.cycles - 1;
+    return left > UINT32_MAX ? UINT32_MAX : left;
+}
+
+// RAM and ROM only change through the cpu, and the ppu status only on the
+// scheduled events unless a sprite 0 hit can come in between. Anything else
+// (joypads, other ppu registers) isn't safe to skip over. Polling loops read
+// the status, so the ppu isn't far behind
+static u64 nes_idle_until(const u16 *addrs, int n) {
+    ppu_state_t *ppu = &state.ppu_st;
+    bool status_fixed = ppu->ppustatus.S || (!ppu->ppumask.b && !ppu->ppumask.s) ||
+                        (ppu->_row >= 240 && ppu->_row <= 260) || !ppu_sprite0_can_hit(ppu);
+    for (int i=0; i<n; i++) {
+        if (state.cpu_mem.read_pages[addrs[i] >> 8] != NULL) continue;
+        if ((addrs[i] & 0xE007) == 0x2002 && status_fixed) continue;
+        return 0;
+    }
+    return state.sched.next;
+}
+
+static void nes_oam_dma() {
+    // DMA starts on an even cycle, with one more wait cycle if it's odd
+    if (state.cpu_st.cycles % 2 == 0) cpu_tick(&state.cpu_st);
+    dma_oam(&state.dma_oam, &state.cpu_st);
+}
+
+// Fires the events that are due, stopping at the end of a frame
+static void nes_run_events() {
+    sched_event_t ev;
+    while (!state.frame_done && sched_pop_due(&state.sched, state.cpu_st.cycles, &ev)) {
+        switch (ev) {
+            case SCHED_VBLANK_START:
+            case SCHED_NMI:
+            case SCHED_VBLANK_END:
+                nes_ppu_catch_up();
+                break;
+            case SCHED_DMA:
+                nes_oam_dma();
+                break;
+            default:
+                break;
         }
     }
 }
 
 void nes_cpu_init(cpu_state_t *st) {
-    st->tick = &nes_cpu_tick_callback;
     st->bus_read = &nes_cpu_bus_read;
     st->bus_write = &nes_cpu_bus_write;
+    st->read_pages = state.cpu_mem.read_pages;
+    st->write_pages = state.cpu_mem.write_pages;
+    nes_map_cpu_pages();
 
-    st->P.u = st->P.B = 1;
+    cpu_set_p(st, 0x30); // B, u always read as high
     st->RST = 1;
+
+    st->idle_until = &nes_idle_until;
+    cpu_decode_cache_init(st, 0x8000, 0x8000);
 }
 
 void nes_ppu_init(ppu_state_t *st) {
     st->bus_read = &nes_ppu_bus_read;
     st->bus_write = &nes_ppu_bus_write;
-
-    // the pixeltao palette looks better
-    st->_rgb_palette = (u8*)palette_memory;
+    st->chr_rows = state.rom.chr_rows;
+    st->chr_rows_flipped = state.rom.chr_rows_flipped;
 }
 
 void nes_load_palette(char *palette_path) {
@@ -163,9 +269,12 @@ void nes_load_palette(char *palette_path) {
 
 void nes_init(char* rom_path) {
     disp_init();
+    // the pixeltao palette looks better, or whatever nes_load_palette read
+    disp_set_palette(palette_memory);
     rom_load_from_file(&state.rom, rom_path);
     
     // cpu init code
+    sched_init(&state.sched);
     nes_cpu_init(&state.cpu_st);
     nes_ppu_init(&state.ppu_st);
 
@@ -177,31 +286,37 @@ void nes_init(char* rom_path) {
         ppu_tick(&state.ppu_st, &state.cpu_st);
         state.ppu_cycle++;
     }
+    nes_ppu_catch_up();
+}
+
+bool nes_set_cpu_backend(nes_cpu_backend_t backend) {
+    jit_free(&state.cpu_st);
+    if (backend == NES_CPU_JIT) {
+        return jit_init(&state.cpu_st, state.cpu_mem.wram, &nes_prg_rom_ptr,
+                        &nes_cpu_cycles_to_event);
+    }
+    return true;
 }
 
 void nes_exit() {
+    log_info("Skipped %" PRIu64 " idle cpu cycles", state.cpu_st.idle_cycles_skipped);
     disp_free();
+    jit_free(&state.cpu_st);
+    cpu_decode_cache_free(&state.cpu_st);
     rom_free(&state.rom);
 }
 
-bool nes_update_events() {
-    SDL_Event event;
-    bool exit = false;
-    while(SDL_PollEvent(&event)) {
-        // TODO process other events too
-        // TODO SDL stalls when the window moves to another display (tested 
-        // on MacOS 14, moving from a retina to a non-retina display stalls 
-        // the emulator. Moving back doesn't unstall it)
-        if (event.type == SDL_QUIT || (event.type == SDL_WINDOWEVENT &&
-                                       event.window.event == SDL_WINDOWEVENT_CLOSE)) {
-            exit = true;
-        }
-    }
-    joypad_update(&state.joypad);
-    return exit;
+bool nes_update_events(u8 *hotkeys) {
+    return disp_poll(&state.joypad.state, hotkeys);
 }
 
 #ifdef NES_DEBUG
+// reads that can't trigger register side effects, for the disassembler
+static u8 nes_cpu_bus_peek(u16 addr) {
+    if (addr >= 0x2000 && addr < 0x4020) return 0;
+    return nes_cpu_bus_read(addr);
+}
+
 u64 breakpoint = 0;
 bool stepping = true;
 char input_buf[64];
@@ -210,18 +325,22 @@ char input_buf[64];
 void nes_render_frame() {
 #ifdef NES_DEBUG
     while (!state.frame_done) {
-        if (state.dma_oam.enabled) {
-            if (state.cpu_cycle % 2 == 0) state.cpu_st.tick();
-            dma_oam(&state.dma_oam, &state.cpu_st, &state.ppu_st);
-            state.dma_oam.enabled = false;
+        if (state.cpu_st.cycles >= state.sched.next) {
+            nes_run_events();
+            continue;
         }
         cpu_exec(&state.cpu_st);
-        if ((stepping && state.cpu_cycle >= breakpoint) || (!stepping)) {
+        if ((stepping && state.cpu_st.cycles >= breakpoint) || (!stepping)) {
             stepping = false;
+            nes_ppu_catch_up();
             ppu_state_to_str(&state.ppu_st, ppu_state_buf);
             log_debug(ppu_state_buf);
             cpu_state_to_str(&state.cpu_st, cpu_state_buf);
             log_debug(cpu_state_buf);
+            u16 pc = state.cpu_st.PC;
+            u8 bytes[3] = { nes_cpu_bus_peek(pc), nes_cpu_bus_peek(pc+1), nes_cpu_bus_peek(pc+2) };
+            cpu_disasm(pc, bytes, disasm_buf);
+            log_debug(disasm_buf);
             printf("> ");
             fgets(input_buf, 64, stdin);
             char ch = input_buf[0];
@@ -233,15 +352,36 @@ void nes_render_frame() {
         }
     }
     state.frame_done = false;
+    nes_ppu_catch_up();
 #else
     while (!state.frame_done) {
-        if (state.dma_oam.enabled) {
-            if (state.cpu_cycle % 2 == 0) state.cpu_st.tick();
-            dma_oam(&state.dma_oam, &state.cpu_st, &state.ppu_st);
-            state.dma_oam.enabled = false;
-        }
-        cpu_exec(&state.cpu_st);
+        while (state.cpu_st.cycles < state.sched.next) cpu_exec(&state.cpu_st);
+        nes_run_events();
     }
     state.frame_done = false;
+    nes_ppu_catch_up();
 #endif
 }
+
+// Emulates a frame, then runs `ahead` frames further with the same input and
+// shows the last of them before going back. Input shows up `ahead` frames
+// sooner than the game would show it, at the cost of emulating them
+void nes_render_frame_ahead(u32 ahead) {
+    static void *saved;
+    if (ahead == 0) {
+        nes_render_frame();
+        return;
+    }
+    if (saved == NULL && (saved = malloc(savestate_size())) == NULL) {
+        log_fatal("Could not allocate the run-ahead state");
+        exit(-1);
+    }
+
+    disp_suppress(true);
+    nes_render_frame();
+    savestate_save(saved);
+    for (u32 i=1; i<ahead; i++) nes_render_frame();
+    disp_suppress(false);
+    nes_render_frame();
+    savestate_load(saved, savestate_size());
+}
@@ -10,6 +10,7 @@
 #include "rom.h"
 #include "dma.h"
 #include "joypad.h"
+#include "sched.h"
 
 typedef struct {
 
@@ -26,7 +27,9 @@ typedef struct {
     dma_oam_t dma_oam;
 
     u64 ppu_cycle;
-    u64 cpu_cycle;
+    u64 cpu_cycle; // cpu cycle the ppu has been run up to
+
+    sched_t sched;
 } nes_state_t;
 
 typedef struct {
@@ -34,15 +37,25 @@ typedef struct {
 
 } nes_input_t;
 
+typedef enum {
+    NES_CPU_INTERPRETER = 0,
+    NES_CPU_JIT = 1
+} nes_cpu_backend_t;
+
 u8 nes_cpu_bus_read(u16 addr);
 u8 nes_ppu_bus_read(u16 addr);
 void nes_cpu_bus_write(u8 data, u16 addr);
 void nes_ppu_bus_write(u8 data, u16 addr);
 
+void nes_ppu_catch_up();
+void nes_map_cpu_pages();
+
 void nes_load_palette(char* palette_path);
 void nes_init(char* rom_path);
-bool nes_update_events();
+bool nes_set_cpu_backend(nes_cpu_backend_t backend);
+bool nes_update_events(u8 *hotkeys);
 void nes_exit();
 void nes_render_frame();
+void nes_render_frame_ahead(u32 ahead);
 
 #endif
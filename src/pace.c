@@ -0,0 +1,117 @@
+// SPDX-License-Identifier: GPL-3.0-or-later
+// Copyright 2024 neov5
+
+#include "pace.h"
+#include "log.h"
+#include <errno.h>
+#include <string.h>
+#include <time.h>
+
+// more than this far behind (a stall, a breakpoint, the window being dragged)
+// and catching up would mean running flat out for a while, start over instead
+#define PACE_MAX_LAG_NS (4 * PACE_PERIOD_NS)
+
+u64 pace_now() {
+    struct timespec t;
+    clock_gettime(CLOCK_MONOTONIC, &t);
+    return (u64)t.tv_sec * 1000000000ULL + t.tv_nsec;
+}
+
+static void pace_sleep_until(u64 when) {
+#ifdef __APPLE__
+    // no clock_nanosleep, a relative sleep is close enough with the spin tail
+    u64 now = pace_now();
+    if (when <= now) return;
+    nanosleep(&(struct timespec){ (when - now) / 1000000000ULL, (when - now) % 1000000000ULL }, NULL);
+#else
+    struct timespec t = { when / 1000000000ULL, when % 1000000000ULL };
+    // only a signal is worth sleeping again after, the spin tail and the
+    // next frame's deadline cover anything else
+    static bool warned;
+    int err;
+    while ((err = clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &t, NULL)) == EINTR);
+    if (err && !warned) {
+        log_warn("Could not sleep until the next frame: %s", strerror(err));
+        warned = true;
+    }
+#endif
+}
+
+static void pace_advance(pace_t *p) {
+    p->deadline += PACE_PERIOD_NS;
+    p->deadline_rem += PACE_PERIOD_REM;
+    if (p->deadline_rem >= PACE_PERIOD_DEN) {
+        p->deadline_rem -= PACE_PERIOD_DEN;
+        p->deadline++;
+    }
+}
+
+void pace_init(pace_t *p, u64 spin_ns) {
+    *p = (pace_t){ .spin_ns = spin_ns, .min_ns = UINT64_MAX };
+    p->deadline = pace_now();
+    pace_advance(p);
+}
+
+i64 pace_left(const pace_t *p) {
+    return (i64)(p->deadline - pace_now());
+}
+
+void pace_wait(pace_t *p, bool sleep) {
+    u64 now = pace_now();
+    if (sleep && now > p->deadline) p->missed++;
+    else if (sleep) {
+        if (p->deadline - now > p->spin_ns) pace_sleep_until(p->deadline - p->spin_ns);
+        while ((now = pace_now()) < p->deadline);
+    }
+
+    if (p->last) {
+        u64 ns = now - p->last;
+        u64 bucket = ns / PACE_HIST_BUCKET_NS;
+        p->hist[bucket < PACE_HIST_BUCKETS ? bucket : PACE_HIST_BUCKETS - 1]++;
+        p->frames++;
+        p->total_ns += ns;
+        if (ns < p->min_ns) p->min_ns = ns;
+        if (ns > p->max_ns) p->max_ns = ns;
+    }
+    p->last = now;
+
+    pace_advance(p);
+    // when something else paces the timeline is only for pace_left, keep it
+    // a frame from now
+    if (!sleep || now > p->deadline + PACE_MAX_LAG_NS) {
+        if (sleep) p->resyncs++;
+        p->deadline = now;
+        p->deadline_rem = 0;
+        pace_advance(p);
+    }
+}
+
+// upper end of the bucket the given fraction of frames are at or under
+static double pace_percentile_ms(const pace_t *p, double frac) {
+    u64 want = (u64)(frac * p->frames + 0.5), seen = 0;
+    for (u32 i = 0; i < PACE_HIST_BUCKETS; i++) {
+        seen += p->hist[i];
+        if (seen >= want && seen) return (i + 1) * PACE_HIST_BUCKET_NS / 1e6;
+    }
+    return p->max_ns / 1e6;
+}
+
+void pace_print_stats(const pace_t *p, FILE *f) {
+    if (!p->frames) {
+        fprintf(f, "no frames timed\n");
+        return;
+    }
+    fprintf(f, "frames %" PRIu64 ", target %.3f ms (%.4f Hz)\n", p->frames,
+            (PACE_PERIOD_NS + (double)PACE_PERIOD_REM / PACE_PERIOD_DEN) / 1e6,
+            1e9 / (PACE_PERIOD_NS + (double)PACE_PERIOD_REM / PACE_PERIOD_DEN));
+    fprintf(f, "frame time min %.3f mean %.3f max %.3f ms, p50 <= %.2f p99 <= %.2f ms\n",
+            p->min_ns / 1e6, p->total_ns / 1e6 / p->frames, p->max_ns / 1e6,
+            pace_percentile_ms(p, 0.5), pace_percentile_ms(p, 0.99));
+    fprintf(f, "missed deadlines %" PRIu64 ", resyncs %" PRIu64 "\n", p->missed, p->resyncs);
+    for (u32 i = 0; i < PACE_HIST_BUCKETS; i++) {
+        if (!p->hist[i]) continue;
+        if (i == PACE_HIST_BUCKETS - 1) fprintf(f, "  >= %6.2f ms", i * PACE_HIST_BUCKET_NS / 1e6);
+        else fprintf(f, "  %6.2f-%6.2f ms", i * PACE_HIST_BUCKET_NS / 1e6, (i + 1) * PACE_HIST_BUCKET_NS / 1e6);
+        fprintf(f, " %8u  %5.1f%%\n", p->hist[i], 100.0 * p->hist[i] / p->frames);
+    }
+}
@@ -0,0 +1,49 @@
+// SPDX-License-Identifier: GPL-3.0-or-later
+// Copyright 2024 neov5
+
+#ifndef __PACE_H__
+#define __PACE_H__
+
+#include "types.h"
+#include <stdbool.h>
+#include <stdio.h>
+
+// NTSC frames are 357366 master clocks of 236.25/11 MHz, 60.0988 Hz. The
+// period is kept as whole ns plus 945ths of one so deadlines never drift
+#define PACE_PERIOD_NS 16639263ULL
+#define PACE_PERIOD_REM 465
+#define PACE_PERIOD_DEN 945
+
+// frame times in 0.25ms buckets, the last one for everything longer
+#define PACE_HIST_BUCKET_NS 250000ULL
+#define PACE_HIST_BUCKETS 128
+
+// Frames are due on a fixed timeline of absolute deadlines instead of a
+// period after the last one, so oversleeping one frame is made up in the next
+typedef struct {
+    u64 deadline; // CLOCK_MONOTONIC ns
+    u32 deadline_rem;
+    u64 spin_ns; // of every wait, spent busy waiting instead of asleep
+    u64 last; // when the last frame was let out, 0 before the first
+
+    u32 hist[PACE_HIST_BUCKETS];
+    u64 frames;
+    u64 missed; // frames that were done after their deadline, when sleeping
+    u64 resyncs; // times the timeline was given up on and restarted
+    u64 total_ns, min_ns, max_ns;
+} pace_t;
+
+void pace_init(pace_t *p, u64 spin_ns);
+u64 pace_now();
+
+// ns until the current frame's deadline, negative if it's already late
+i64 pace_left(const pace_t *p);
+
+// Ends a frame: sleeps until its deadline if sleep is set (not when
+// something else paces, like vsync or running unthrottled), records how long
+// the frame took and moves on to the next deadline
+void pace_wait(pace_t *p, bool sleep);
+
+void pace_print_stats(const pace_t *p, FILE *f);
+
+#endif
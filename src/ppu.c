@@ -51,12 +51,40 @@ void ppu_y_incr(ppu_state_t *st) {
     }
 }
 
+// The sprites in range of each line, one bit per OAM entry, so evaluation
+// is a lookup per step. Moved along with a sprite's y on OAM writes, and
+// rebuilt when OAM changes all at once
+static u64 sprite_rows[240];
+static bool sprite_rows_valid;
+
+void ppu_oam_changed() {
+    sprite_rows_valid = false;
+}
+
+static void ppu_sprite_rows_update(u8 y, u8 i, bool in_range) {
+    for (int row = y; row <= y + 7 && row < 240; row++) {
+        if (in_range) sprite_rows[row] |= 1ULL << i;
+        else sprite_rows[row] &= ~(1ULL << i);
+    }
+}
+
+static void ppu_sprite_rows_build(ppu_state_t *st) {
+    memset(sprite_rows, 0, sizeof(sprite_rows));
+    for (int i=0; i<64; i++) ppu_sprite_rows_update(st->oam.sprites[i].y, i, true);
+    sprite_rows_valid = true;
+}
+
 u8 ppu_oamdata_read(ppu_state_t *st) {
     if (st->_row >= 0 && st->_row <= 239 && st->_col >= 1 && st->_col <= 64) return 0xFF;
     return st->oam.data[st->oamaddr];
 }
 
 void ppu_oamdata_write(ppu_state_t *st, u8 data) {
+    // only y decides which lines a sprite is on
+    if ((st->oamaddr & 0x3) == 0 && sprite_rows_valid) {
+        ppu_sprite_rows_update(st->oam.data[st->oamaddr], st->oamaddr >> 2, false);
+        ppu_sprite_rows_update(data, st->oamaddr >> 2, true);
+    }
     st->oam.data[st->oamaddr++] = data;
 }
 
@@ -190,26 +218,11 @@ void ppu_put_pixel(ppu_state_t *st) {
     u64 mask = 0xFULL << shift;
     u8 bg_pixel = (st->_pix_sr & mask)>>shift;
 
-    u8 sprite_pixel = 0;
-    u8 sprite_index = 255;
-    bool sprite_priority = false;
-    bool sprite_pixel_found = false;
-    for (int i=0; i<st->_num_sprites_on_curr_scanline; i++) {
-        // TODO this check bugs out for sprites whose x is less than 0. It
-        // clips the sprites on the left of the screen early. Shouldn't happen.
-        if (st->_sprite_ctrs[i] <= 7 && st->_sprite_ctrs[i] >= 0) {
-            // TODO sprite priority quirk with BG sprites
-            // find the first opaque sprite pixel
-            sprite_pixel_found = true;
-            shift = st->_sprite_ctrs[i]*4;
-            mask = 0xFU << shift;
-            sprite_pixel = (st->_sprite_srs[i] & mask)>>shift;
-            sprite_priority = st->_sprite_priorities[i];
-            sprite_index = st->_sprite_idxs[i];
-            // this is a higher priority sprite than other sprites which may be drawn
-            if ((sprite_pixel & 0x3) != 0) break;
-        }
-    }
+    u8 sprite = st->_sprite_pos < 256 ? st->_sprite_line[st->_sprite_pos] : 0;
+    u8 sprite_pixel = sprite & 0xF;
+    u8 sprite_index = st->_sprite_idxs[(sprite >> 4) & 0x7];
+    bool sprite_priority = sprite & 0x80;
+    bool sprite_pixel_found = sprite != 0;
     sprite_pixel |= 0x10; // sprite palette is from 0x10-0x1F
 
     u8 final_pixel = 0;
@@ -240,68 +253,72 @@ void ppu_put_pixel(ppu_state_t *st) {
         }
     }
 
-    u8 palette_idx = ppu_palette_ram_read(st, final_pixel);
+    // what the game can see is done, the rest is only for the picture
+    if (disp_suppressed) return;
+
+    // greyscale keeps only the column of greys
+    u8 palette_idx = ppu_palette_ram_read(st, final_pixel) & (st->ppumask.S ? 0x30 : 0x3F);
 
-    disp_putpixel(st->_col-1, st->_row,
-            st->_rgb_palette[palette_idx*3], st->_rgb_palette[palette_idx*3+1], st->_rgb_palette[palette_idx*3+2]);
+    disp_putpixel(st->_col-1, st->_row, palette_idx, st->ppumask.data >> 5);
+}
+
+static void ppu_fetch_nt(ppu_state_t *st) {
+    u16 nt_addr = 0x2000 | (st->_v.data & 0x0FFF);
+    st->_pt_addr = st->bus_read(nt_addr);
+}
+
+static void ppu_fetch_at(ppu_state_t *st) {
+    ppu_at_addr_t at_addr = {
+        .X = (st->_v.X)>>2,
+        .Y = (st->_v.Y)>>2,
+        .O = 0xFU,
+        .N = st->_v.N,
+        .u = 2
+    };
+    u8 at_blk = st->bus_read(at_addr.data);
+    u8 shift_idx = (st->_v.X & 0x2)>>1 | (st->_v.Y & 0x2);
+    shift_idx *= 2;
+    u32 pal_idx = (at_blk & (0x3 << shift_idx)) >> shift_idx;
+    st->_pix_buf = pal_idx;
+    st->_pix_buf |= (st->_pix_buf << 4);
+    st->_pix_buf |= (st->_pix_buf << 8);
+    st->_pix_buf |= (st->_pix_buf << 16);
+    st->_pix_buf <<= 2;
+}
+
+// the decoded row behind a pattern table address, both planes
+static inline u32 ppu_chr_row(const u32 *rows, ppu_pt_addr_t addr) {
+    return rows[(addr.data >> 4) << 3 | addr.y];
+}
+
+// plane 0 is the LSBits, plane 1 the MSBits
+static void ppu_fetch_pt(ppu_state_t *st, u8 plane) {
+    ppu_pt_addr_t pt_addr = {
+        .y = st->_v.y,
+        .P = plane,
+        .N = st->_pt_addr,
+        .H = st->ppuctrl.B,
+        .Z = 0
+    };
+    st->_pix_buf |= ppu_chr_row(st->chr_rows, pt_addr) & (0x11111111U << plane);
 }
 
 void ppu_get_next_pixel(ppu_state_t *st) {
     if (st->_col % 8 == 2) {
         // nametable fetch
-        u16 nt_addr = 0x2000 | (st->_v.data & 0x0FFF);
-        st->_pt_addr = st->bus_read(nt_addr);
+        ppu_fetch_nt(st);
     }
     else if (st->_col % 8 == 4) {
         // attribute table fetch
-        ppu_at_addr_t at_addr = {
-            .X = (st->_v.X)>>2,
-            .Y = (st->_v.Y)>>2,
-            .O = 0xFU,
-            .N = st->_v.N,
-            .u = 2
-        };
-        u8 at_blk = st->bus_read(at_addr.data);
-        u8 shift_idx = (st->_v.X & 0x2)>>1 | (st->_v.Y & 0x2);
-        shift_idx *= 2;
-        u32 pal_idx = (at_blk & (0x3 << shift_idx)) >> shift_idx;
-        st->_pix_buf = pal_idx;
-        st->_pix_buf |= (st->_pix_buf << 4);
-        st->_pix_buf |= (st->_pix_buf << 8);
-        st->_pix_buf |= (st->_pix_buf << 16);
-        st->_pix_buf <<= 2;
+        ppu_fetch_at(st);
     }
     else if (st->_col % 8 == 6) {
         // BG LSBits fetch
-        ppu_pt_addr_t pt_lsb_addr = {
-            .y = st->_v.y,
-            .P = 0,
-            .N = st->_pt_addr,
-            .H = st->ppuctrl.B,
-            .Z = 0
-        };
-        u8 lsb = st->bus_read(pt_lsb_addr.data);
-        u32 bg_lsb = lsb;
-        bg_lsb = (bg_lsb | (bg_lsb << 12)) & 0x000F000F;
-        bg_lsb = (bg_lsb | (bg_lsb << 6))  & 0x03030303;
-        bg_lsb = (bg_lsb | (bg_lsb << 3))  & 0x11111111;
-        st->_pix_buf |= bg_lsb;
+        ppu_fetch_pt(st, 0);
     }
     else if (st->_col % 8 == 0) {
         // BG MSBits fetch
-        ppu_pt_addr_t pt_msb_addr = {
-            .y = st->_v.y,
-            .P = 1,
-            .N = st->_pt_addr,
-            .H = st->ppuctrl.B,
-            .Z = 0
-        };
-        u8 msb = st->bus_read(pt_msb_addr.data);
-        u32 bg_msb = msb;
-        bg_msb = (bg_msb | (bg_msb << 12)) & 0x000F000F;
-        bg_msb = (bg_msb | (bg_msb << 6))  & 0x03030303;
-        bg_msb = (bg_msb | (bg_msb << 3))  & 0x11111111;
-        st->_pix_buf |= (bg_msb << 1);
+        ppu_fetch_pt(st, 1);
 
         ppu_shift_bufs(st);
         ppu_coarse_x_incr(st);
@@ -309,6 +326,17 @@ void ppu_get_next_pixel(ppu_state_t *st) {
     }
 }
 
+// The four fetches of the next background tile, 8 pixels of 4 bits with the
+// leftmost on top
+static u32 ppu_fetch_tile(ppu_state_t *st) {
+    ppu_fetch_nt(st);
+    ppu_fetch_at(st);
+    ppu_fetch_pt(st, 0);
+    ppu_fetch_pt(st, 1);
+    ppu_coarse_x_incr(st);
+    return st->_pix_buf;
+}
+
 void ppu_load_vert_addr(ppu_state_t *st) {
     st->_v.y = st->_t.y;
     st->_v.Y = st->_t.Y;
@@ -374,34 +402,37 @@ void ppu_sprite_eval(ppu_state_t *st) {
     }
     else if (st->_col == 64) {
         memset(st->sec_oam.data, 0xFF, 32);
-        st->_oam_ctr = 0;
         st->_sec_oam_ctr = 0;
     }
-    else if (st->_col <= 256 && st->_oam_ctr < 64) {
-        // TODO is the _oam_ctr check correct?
-        //
+    else if (st->_col <= 256 && st->_col % 2 == 0) {
         // instead of the odd-even cycle thing, do the read and write both 
-        // on the even cycle
-        if (st->_col % 2 == 0) {
-            // range check
-            ppu_sprite_t sp = st->oam.sprites[st->_oam_ctr];
-            if (sp.y <= st->_row && sp.y >= st->_row-7) {
-                // in range
-                if (st->_sec_oam_ctr == 8) return;
-                st->sec_oam.sprites[st->_sec_oam_ctr] = sp;
-                st->_sprite_idxs[st->_sec_oam_ctr++] = st->_oam_ctr;
-            }
-            // TODO sprite overflow (step 2.3)
-            if (st->_oam_ctr < 63) st->_oam_ctr++;
+        // on the even cycle. One sprite per step, staying on sprite 63 once
+        // it gets there
+        if (!sprite_rows_valid) ppu_sprite_rows_build(st);
+        u8 i = (st->_col - 66) / 2;
+        if (i > 63) i = 63;
+        if ((sprite_rows[st->_row] >> i) & 1) {
+            // in range
+            if (st->_sec_oam_ctr == 8) return;
+            st->sec_oam.sprites[st->_sec_oam_ctr] = st->oam.sprites[i];
+            st->_sprite_idxs[st->_sec_oam_ctr++] = i;
         }
+        // TODO sprite overflow (step 2.3)
     }
 }
 
 void ppu_sprite_reload(ppu_state_t *st) {
     st->_num_sprites_on_curr_scanline = st->_num_sprites_on_next_scanline;
+    memset(st->_sprite_line, 0, sizeof(st->_sprite_line));
+    st->_sprite_pos = 0;
     for (int i=0; i<st->_num_sprites_on_curr_scanline; i++) {
-        st->_sprite_ctrs[i] = st->sec_oam.sprites[i].x + 7;
-        st->_sprite_priorities[i] = (st->sec_oam.sprites[i].attr & 0x20);
+        ppu_sprite_t sprite = st->sec_oam.sprites[i];
+        for (int x = sprite.x; x < sprite.x + 8 && x < 256; x++) {
+            // a lower slot's opaque pixel wins
+            if (st->_sprite_line[x] & 0x3) continue;
+            u8 pixel = (st->_sprite_srs[i] >> ((sprite.x + 7 - x) * 4)) & 0xF;
+            st->_sprite_line[x] = pixel | i << 4 | ((sprite.attr & 0x20) ? 0x80 : 0);
+        }
     }
 }
 
@@ -430,66 +461,28 @@ void ppu_sprite_fetch(ppu_state_t *st) {
         *sprite_sr |= (*sprite_sr << 8);
         *sprite_sr |= (*sprite_sr << 16);
     }
-    else if (st->_col % 8 == 6) {
-        // Sprite LSBits fetch
-        u8 y_addr = st->_row - sprite.y;
-        if (sprite.attr & 0x80) y_addr = 7-y_addr; // vertical flip
-        ppu_pt_addr_t pt_lsb_addr = {
-            .y = y_addr,
-            .P = 0,
-            .N = sprite.index,
-            .H = st->ppuctrl.S,
-            .Z = 0
-        };
-        u8 lsb = st->bus_read(pt_lsb_addr.data);
-        u32 bg_lsb = lsb;
-        if (sprite.attr & 0x40) { // horizontal flip
-            bg_lsb = ((bg_lsb >> 4) | (bg_lsb << 16)) & 0x000F000F;
-            bg_lsb = ((bg_lsb >> 2) | (bg_lsb << 8))  & 0x03030303;
-            bg_lsb = ((bg_lsb >> 1) | (bg_lsb << 4))  & 0x11111111;
-        }
-        else {
-            bg_lsb = (bg_lsb | (bg_lsb << 12)) & 0x000F000F;
-            bg_lsb = (bg_lsb | (bg_lsb << 6))  & 0x03030303;
-            bg_lsb = (bg_lsb | (bg_lsb << 3))  & 0x11111111;
-        }
-        *sprite_sr |= bg_lsb;
-    }
-    else if (st->_col % 8 == 0) {
-        // Sprite MSBits fetch
+    else if (st->_col % 8 == 6 || st->_col % 8 == 0) {
+        // Sprite LSBits, then MSBits fetch
+        u8 plane = st->_col % 8 == 0;
         u8 y_addr = st->_row - sprite.y;
         if (sprite.attr & 0x80) y_addr = 7-y_addr; // vertical flip
-        ppu_pt_addr_t pt_msb_addr = {
+        ppu_pt_addr_t pt_addr = {
             .y = y_addr,
-            .P = 1,
+            .P = plane,
             .N = sprite.index,
             .H = st->ppuctrl.S,
             .Z = 0
         };
-        u8 msb = st->bus_read(pt_msb_addr.data);
-        u32 bg_msb = msb;
-        if (sprite.attr & 0x40) { // horizontal flip
-            bg_msb = ((bg_msb >> 4) | (bg_msb << 16)) & 0x000F000F;
-            bg_msb = ((bg_msb >> 2) | (bg_msb << 8))  & 0x03030303;
-            bg_msb = ((bg_msb >> 1) | (bg_msb << 4))  & 0x11111111;
-        }
-        else {
-            bg_msb = (bg_msb | (bg_msb << 12)) & 0x000F000F;
-            bg_msb = (bg_msb | (bg_msb << 6))  & 0x03030303;
-            bg_msb = (bg_msb | (bg_msb << 3))  & 0x11111111;
-        }
-        *sprite_sr |= (bg_msb << 1);
+        // horizontal flip
+        const u32 *rows = (sprite.attr & 0x40) ? st->chr_rows_flipped : st->chr_rows;
+        *sprite_sr |= ppu_chr_row(rows, pt_addr) & (0x11111111U << plane);
 
-        st->_sec_oam_ctr++;
+        if (plane) st->_sec_oam_ctr++;
     }
 }
 
 void ppu_sprite_update(ppu_state_t *st) {
-    if (st->_col <= 256) {
-        for (int i=0; i<st->_num_sprites_on_curr_scanline; i++) {
-            st->_sprite_ctrs[i]--;
-        }
-    }
+    if (st->_col <= 256 && st->_sprite_pos < 256) st->_sprite_pos++;
 }
 
 void ppu_render_visible_scanline_tick(ppu_state_t *ppu_st, cpu_state_t *cpu_st) {
@@ -523,6 +516,210 @@ void ppu_render_visible_scanline_tick(ppu_state_t *ppu_st, cpu_state_t *cpu_st)
     // TODO garbage nametable fetches - MMC5 uses them
 }
 
+// The priority mux of ppu_put_pixel over a whole line. bg and sp are 4 bit
+// pixels (sp with 0x10 set, 0 where there's no sprite), behind and hit 0xFF
+// where the sprite is behind the background and where it would set sprite 0
+// hit over an opaque background pixel. Returns the first col that hits, or -1.
+// The scalar one is the reference for the vector ones
+static int ppu_mux_line_scalar(u8 *out, const u8 *bg, const u8 *sp, const u8 *behind, const u8 *hit) {
+    int first_hit = -1;
+    for (int col=0; col<256; col++) {
+        bool bg_opaque = bg[col] & 0x3, sp_opaque = sp[col] & 0x3;
+        if (bg_opaque && sp_opaque && hit[col] && first_hit < 0) first_hit = col;
+        out[col] = sp_opaque && !(bg_opaque && behind[col]) ? sp[col] : bg[col];
+    }
+    return first_hit;
+}
+
+#if defined(__x86_64__) && defined(__GNUC__)
+#include <immintrin.h>
+
+static int ppu_mux_line_sse2(u8 *out, const u8 *bg, const u8 *sp, const u8 *behind, const u8 *hit) {
+    const __m128i three = _mm_set1_epi8(3), zero = _mm_setzero_si128();
+    int first_hit = -1;
+    for (int col=0; col<256; col+=16) {
+        __m128i b = _mm_loadu_si128((const __m128i*)(bg + col));
+        __m128i s = _mm_loadu_si128((const __m128i*)(sp + col));
+        __m128i b_clear = _mm_cmpeq_epi8(_mm_and_si128(b, three), zero);
+        __m128i s_clear = _mm_cmpeq_epi8(_mm_and_si128(s, three), zero);
+        // the background wins where the sprite is clear, or behind an opaque pixel
+        __m128i bg_wins = _mm_or_si128(s_clear, _mm_andnot_si128(b_clear, _mm_loadu_si128((const __m128i*)(behind + col))));
+        _mm_storeu_si128((__m128i*)(out + col), _mm_or_si128(_mm_and_si128(bg_wins, b), _mm_andnot_si128(bg_wins, s)));
+        u32 mask = _mm_movemask_epi8(_mm_andnot_si128(_mm_or_si128(b_clear, s_clear),
+                                                      _mm_loadu_si128((const __m128i*)(hit + col))));
+        if (mask && first_hit < 0) first_hit = col + __builtin_ctz(mask);
+    }
+    return first_hit;
+}
+
+// same, 32 pixels at a time
+__attribute__((target("avx2")))
+static int ppu_mux_line_avx2(u8 *out, const u8 *bg, const u8 *sp, const u8 *behind, const u8 *hit) {
+    const __m256i three = _mm256_set1_epi8(3), zero = _mm256_setzero_si256();
+    int first_hit = -1;
+    for (int col=0; col<256; col+=32) {
+        __m256i b = _mm256_loadu_si256((const __m256i*)(bg + col));
+        __m256i s = _mm256_loadu_si256((const __m256i*)(sp + col));
+        __m256i b_clear = _mm256_cmpeq_epi8(_mm256_and_si256(b, three), zero);
+        __m256i s_clear = _mm256_cmpeq_epi8(_mm256_and_si256(s, three), zero);
+        __m256i bg_wins = _mm256_or_si256(s_clear, _mm256_andnot_si256(b_clear, _mm256_loadu_si256((const __m256i*)(behind + col))));
+        _mm256_storeu_si256((__m256i*)(out + col), _mm256_blendv_epi8(s, b, bg_wins));
+        u32 mask = _mm256_movemask_epi8(_mm256_andnot_si256(_mm256_or_si256(b_clear, s_clear),
+                                                            _mm256_loadu_si256((const __m256i*)(hit + col))));
+        if (mask && first_hit < 0) first_hit = col + __builtin_ctz(mask);
+    }
+    return first_hit;
+}
+#endif
+
+static int ppu_mux_line_pick(u8 *out, const u8 *bg, const u8 *sp, const u8 *behind, const u8 *hit);
+static int (*ppu_mux_line)(u8 *out, const u8 *bg, const u8 *sp, const u8 *behind, const u8 *hit) = ppu_mux_line_pick;
+
+// picks the widest one the cpu has on the first line
+static int ppu_mux_line_pick(u8 *out, const u8 *bg, const u8 *sp, const u8 *behind, const u8 *hit) {
+    ppu_mux_line = ppu_mux_line_scalar;
+#if defined(__x86_64__) && defined(__GNUC__)
+    ppu_mux_line = __builtin_cpu_supports("avx2") ? ppu_mux_line_avx2 : ppu_mux_line_sse2;
+#endif
+    return ppu_mux_line(out, bg, sp, behind, hit);
+}
+
+// Random lines through every vector mux the cpu has, against the scalar one.
+// Each line has its own density of sprite, behind and hit pixels, so that the
+// first hit lands anywhere from col 0 to none at all
+bool ppu_mux_self_check() {
+    const struct {
+        const char *name;
+        int (*mux)(u8 *out, const u8 *bg, const u8 *sp, const u8 *behind, const u8 *hit);
+        bool usable;
+    } muxes[] = {
+#if defined(__x86_64__) && defined(__GNUC__)
+        { "sse2", ppu_mux_line_sse2, true },
+        { "avx2", ppu_mux_line_avx2, __builtin_cpu_supports("avx2") },
+#endif
+        { NULL, NULL, false }
+    };
+    u8 bg[256], sp[256], behind[256], hit[256], want[256], got[256];
+    u32 seed = 0x2C02; // xorshift, the same lines every run
+    for (u32 line = 0; line < 4096; line++) {
+        u32 density = line & 0xFF;
+        for (int col = 0; col < 256; col++) {
+            seed ^= seed << 13; seed ^= seed >> 17; seed ^= seed << 5;
+            bg[col] = seed & 0xF;
+            sp[col] = ((seed >> 8) & 0xFF) < density ? 0x10 | ((seed >> 4) & 0xF) : 0;
+            behind[col] = (seed >> 16) & 1 ? 0xFF : 0;
+            hit[col] = ((seed >> 24) & 0xFF) < density / 4 ? 0xFF : 0;
+        }
+        int want_hit = ppu_mux_line_scalar(want, bg, sp, behind, hit);
+        for (u32 i = 0; muxes[i].name; i++) {
+            if (!muxes[i].usable) continue;
+            int got_hit = muxes[i].mux(got, bg, sp, behind, hit);
+            if (got_hit != want_hit || memcmp(got, want, sizeof(want))) {
+                log_warn("The %s line mux differs from the scalar one on line %u (first hit %d, not %d)",
+                         muxes[i].name, line, got_hit, want_hit);
+                return false;
+            }
+        }
+    }
+    return true;
+}
+
+// Everything ppu_tick does over cols 1-340 of a visible scanline, with the
+// pixels drawn from whole line buffers instead of dot by dot. Only right if
+// nothing touches the ppu in the meantime, and it leaves the same state
+// behind, fetches included and in the same order
+static void ppu_render_scanline(ppu_state_t *st) {
+    bool b = st->ppumask.b, s = st->ppumask.s;
+
+    if (b) {
+        // the background as a stream of pixels: the two tiles prefetched on
+        // the last line, then the 32 fetched on this one. Pixel n is at fine x
+        // scroll + n
+        u8 bg[16 + 32*8];
+        for (int i=0; i<16; i++) bg[i] = (st->_pix_sr >> (60 - 4*i)) & 0xF;
+        for (int t=0; t<32; t++) {
+            u32 tile = ppu_fetch_tile(st);
+            for (int i=0; i<8; i++) bg[16 + t*8 + i] = (tile >> (28 - 4*i)) & 0xF;
+        }
+        ppu_y_incr(st);
+
+        // evaluation for the next line overwrites _sprite_idxs while this
+        // line is drawn, so sprite 0 hits see the new index from then on
+        u8 old_idxs[8];
+        s16 idx_col[8];
+        memcpy(old_idxs, st->_sprite_idxs, sizeof(old_idxs));
+        for (int i=0; i<8; i++) idx_col[i] = 257;
+        if (s) {
+            st->_col = 64;
+            ppu_sprite_eval(st);
+            if (!sprite_rows_valid) ppu_sprite_rows_build(st);
+            for (u64 rows = sprite_rows[st->_row]; rows && st->_sec_oam_ctr < 8; rows &= rows - 1) {
+                u8 i = __builtin_ctzll(rows);
+                // found again on each step that stays on sprite 63
+                for (int step = i; step <= (i == 63 ? 95 : i) && st->_sec_oam_ctr < 8; step++) {
+                    st->sec_oam.sprites[st->_sec_oam_ctr] = st->oam.sprites[i];
+                    st->_sprite_idxs[st->_sec_oam_ctr] = i;
+                    idx_col[st->_sec_oam_ctr++] = 66 + 2*step;
+                }
+            }
+        }
+
+        // the opaque sprite pixel at each col (0 for none), whether it's
+        // behind the background and from which slot
+        u8 sp[256] = {0}, behind[256] = {0}, sp_slot[256];
+        bool zero_idx = false;
+        for (int i=0; i<st->_num_sprites_on_curr_scanline; i++) {
+            zero_idx |= old_idxs[i] == 0 || st->_sprite_idxs[i] == 0;
+        }
+        for (int col=0; st->_sprite_pos + col < 256; col++) {
+            u8 sprite = st->_sprite_line[st->_sprite_pos + col];
+            if ((sprite & 0x3) == 0) continue;
+            sp[col] = (sprite & 0xF) | 0x10;
+            behind[col] = (sprite & 0x80) ? 0xFF : 0;
+            sp_slot[col] = (sprite >> 4) & 0x7;
+        }
+
+        // where sprite 0 would hit over an opaque background pixel, same as
+        // ppu_put_pixel. Most lines have no sprite 0 to look for
+        u8 hit[256] = {0};
+        if (zero_idx && !st->ppustatus.S) {
+            for (int col=1; col<=256; col++) {
+                if (!sp[col-1] || ((st->ppumask.data & 0x3) && col <= 7) || col == 255) continue;
+                u8 i = sp_slot[col-1];
+                hit[col-1] = (col >= idx_col[i] ? st->_sprite_idxs[i] : old_idxs[i]) == 0 ? 0xFF : 0;
+            }
+        }
+
+        u8 line[256];
+        if (ppu_mux_line(line, bg + st->_x, sp, behind, hit) >= 0) st->ppustatus.S = 1;
+
+        if (!disp_suppressed) {
+            u8 pal[32];
+            for (int i=0; i<32; i++) pal[i] = ppu_palette_ram_read(st, i) & (st->ppumask.S ? 0x30 : 0x3F);
+            for (int col=0; col<256; col++) disp_putpixel(col, st->_row, pal[line[col]], st->ppumask.data >> 5);
+        }
+
+        st->_sprite_pos = 256;
+        ppu_load_horiz_addr(st);
+    }
+
+    if (s) {
+        st->_col = 257;
+        ppu_sprite_fetch(st);
+        for (st->_col = 260; st->_col <= 320; st->_col += 2) {
+            if (st->_col % 8 != 2) ppu_sprite_fetch(st);
+        }
+        ppu_sprite_reload(st);
+    }
+
+    if (b) {
+        // the shift register ends up with just the two tiles for the next line
+        u64 first = ppu_fetch_tile(st);
+        st->_pix_sr = (first << 32) | ppu_fetch_tile(st);
+    }
+    st->_col = 340;
+}
+
 void ppu_postrender_scanline_tick(ppu_state_t *ppu_st, cpu_state_t *cpu_st) {
     if (ppu_st->_col == 1) {
         if (ppu_st->ppumask.b) disp_blit(); 
@@ -533,6 +730,23 @@ void ppu_postrender_scanline_tick(ppu_state_t *ppu_st, cpu_state_t *cpu_st) {
     }
 }
 
+// Sprite 0 is drawn on the 8 lines after its y, and evaluation can hand its
+// index to a slot that's drawn already on the line of its y. A slot drawn now
+// could also still have it from before OAM changed
+bool ppu_sprite0_can_hit(ppu_state_t *st) {
+    for (int i=0; i<st->_num_sprites_on_curr_scanline; i++) {
+        if (st->_sprite_idxs[i] == 0) return true;
+    }
+    s16 row = st->_row == 261 ? -1 : st->_row;
+    return st->oam.sprites[0].y < 240 && row <= st->oam.sprites[0].y + 8;
+}
+
+static ppu_renderer_t renderer = PPU_RENDER_AUTO;
+
+void ppu_set_renderer(ppu_renderer_t r) {
+    renderer = r;
+}
+
 void ppu_tick(ppu_state_t *ppu_st, cpu_state_t *cpu_st) {
 
     ppu_st->_col = (ppu_st->_col+1)%341;
@@ -547,3 +761,57 @@ void ppu_tick(ppu_state_t *ppu_st, cpu_state_t *cpu_st) {
 
 
 }
+
+#define PPU_DOT(row, col) ((row) * 341 + (col))
+#define PPU_FRAME_DOTS PPU_DOT(262, 0)
+
+// How many of the dots after the current one would do nothing. Vblank only
+// sets the flag and raises NMI, and with rendering off the rest of the frame
+// only clears the flags and counts the frame on the prerender line
+static u32 ppu_idle_dots(ppu_state_t *st) {
+    static const u32 busy[] = { PPU_DOT(241, 1), PPU_DOT(241, 4), PPU_DOT(261, 1), PPU_DOT(261, 339) };
+    bool rendering = st->ppumask.b || st->ppumask.s;
+    if (rendering && (st->_row < 240 || st->_row == 261)) return 0;
+
+    u32 now = PPU_DOT(st->_row, st->_col);
+    for (u32 i=0; i<sizeof(busy)/sizeof(busy[0]); i++) {
+        if (busy[i] > now) return busy[i] - now - 1;
+    }
+    return busy[0] + PPU_FRAME_DOTS - now - 1;
+}
+
+void ppu_run(ppu_state_t *st, cpu_state_t *cpu_st, u64 dots) {
+    // pay back what the last scanline ran ahead
+    if (dots <= st->_dots_ahead) {
+        st->_dots_ahead -= dots;
+        return;
+    }
+    dots -= st->_dots_ahead;
+    st->_dots_ahead = 0;
+
+    while (dots) {
+        u64 idle = ppu_idle_dots(st);
+        if (idle) {
+            // straight over it, register accesses only come in between
+            // ppu_runs
+            if (idle > dots) idle = dots;
+            u32 dot = (PPU_DOT(st->_row, st->_col) + idle) % PPU_FRAME_DOTS;
+            st->_row = dot / 341;
+            st->_col = dot % 341;
+            dots -= idle;
+        }
+        else if (st->_col == 0 && st->_row < 240 && renderer != PPU_RENDER_DOT &&
+            (dots >= 340 || renderer == PPU_RENDER_SCANLINE)) {
+            ppu_render_scanline(st);
+            if (dots < 340) {
+                st->_dots_ahead = 340 - dots;
+                return;
+            }
+            dots -= 340;
+        }
+        else {
+            ppu_tick(st, cpu_st);
+            dots--;
+        }
+    }
+}
@@ -111,11 +111,14 @@ typedef struct {
     } sec_oam;
 
     u32 _sprite_srs[8]; // 4 x 8, shifts left
-    s16 _sprite_ctrs[8];
-    bool _sprite_priorities[8];
     u8 _sprite_idxs[8];
 
-    u8 _oam_ctr;
+    // the sprites fetched for this line, drawn out when they're reloaded:
+    // the first opaque pixel at each x (4 bits), its slot (3 bits) and
+    // whether it's behind the background (MSB). 0 where there's none
+    u8 _sprite_line[256];
+    u16 _sprite_pos; // pixels drawn since the reload, stops at 256
+
     u8 _sec_oam_ctr;
 
     u8 _num_sprites_on_next_scanline;
@@ -125,6 +128,9 @@ typedef struct {
 
     u8 (*bus_read)(u16);
     void (*bus_write)(u8, u16);
+    // the ROM's decoded pattern rows, see rom_t
+    const u32 *chr_rows;
+    const u32 *chr_rows_flipped;
 
     bool _init_done;
     bool _odd_frame;
@@ -132,7 +138,6 @@ typedef struct {
 
     s16 _row;
     s16 _col;
-    u8 *_rgb_palette;
 
     u8 _io_bus;
 
@@ -146,6 +151,8 @@ typedef struct {
     u8 _pt_addr;
     u32 _pix_buf; // 4x8
 
+    u16 _dots_ahead; // a scanline drawn at once ran ahead of ppu_run by this much
+
 } ppu_state_t;
 
 void ppu_ppuctrl_write(ppu_state_t *st, u8 data);
@@ -162,7 +169,32 @@ u8 ppu_iobus_read(ppu_state_t *st);
 void ppu_palette_ram_write(ppu_state_t *st, u8 addr, u8 data);
 u8 ppu_palette_ram_read(ppu_state_t *st, u8 addr);
 
+// How visible scanlines are drawn. Dot draws each dot on its own. Scanline
+// draws whole lines at once and delays register writes that land inside one
+// to its end. Auto draws a line at once when ppu_run covers all of it, which
+// with the ppu caught up lazily means no register access landed inside it,
+// and dot by dot otherwise. Auto looks the same as dot
+typedef enum {
+    PPU_RENDER_AUTO,
+    PPU_RENDER_DOT,
+    PPU_RENDER_SCANLINE
+} ppu_renderer_t;
+
+void ppu_set_renderer(ppu_renderer_t r);
+
+// The scanline renderer's vector pixel muxes match the scalar one, checked
+// on random lines. False, with a warning naming the one that doesn't, if not
+bool ppu_mux_self_check();
+
+// OAM changed, through $2004 or DMA, or a save state was loaded
+void ppu_oam_changed();
+
+// False if no sprite 0 hit can come before the next frame starts
+bool ppu_sprite0_can_hit(ppu_state_t *st);
+
 void ppu_tick(ppu_state_t *ppu_st, cpu_state_t *cpu_st);
+// Same as ppu_tick dots times, drawing whole scanlines where it can
+void ppu_run(ppu_state_t *st, cpu_state_t *cpu_st, u64 dots);
 void ppu_init(ppu_state_t *st);
 void ppu_state_to_str(ppu_state_t *st, char buf[128]);
 
@@ -0,0 +1,171 @@
+// SPDX-License-Identifier: GPL-3.0-or-later
+// Copyright 2024 neov5
+
+#include "rewind.h"
+#include "savestate.h"
+#include "log.h"
+#include <stdlib.h>
+#include <string.h>
+
+static inline u64 rewind_word(const u8 *p, size_t i) {
+    u64 w;
+    memcpy(&w, p + i*8, sizeof(w));
+    return w;
+}
+
+// XORs state against ref (zeros if NULL) a word at a time and codes the
+// result as runs: a u16 count of unchanged words, a u16 count of changed
+// words, then the changed words. Returns the coded length
+static u32 rewind_pack(u8 *out, const u8 *state, const u8 *ref, size_t size) {
+    size_t words = size / 8, i = 0;
+    u8 *p = out;
+    while (i < words) {
+        size_t same = i, diff;
+        while (same < words && rewind_word(state, same) == (ref ? rewind_word(ref, same) : 0)) same++;
+        diff = same;
+        while (diff < words && rewind_word(state, diff) != (ref ? rewind_word(ref, diff) : 0)) diff++;
+        u16 run[2] = { same - i, diff - same };
+        memcpy(p, run, sizeof(run));
+        p += sizeof(run);
+        for (size_t j = same; j < diff; j++) {
+            u64 w = rewind_word(state, j) ^ (ref ? rewind_word(ref, j) : 0);
+            memcpy(p, &w, sizeof(w));
+            p += sizeof(w);
+        }
+        i = diff;
+    }
+    return p - out;
+}
+
+static void rewind_unpack(u8 *state, const u8 *in, u32 len, const u8 *ref, size_t size) {
+    if (ref) memcpy(state, ref, size);
+    else memset(state, 0, size);
+    const u8 *end = in + len;
+    size_t i = 0;
+    while (in < end) {
+        u16 run[2];
+        memcpy(run, in, sizeof(run));
+        in += sizeof(run);
+        i += run[0];
+        for (u16 j = 0; j < run[1]; j++, i++, in += 8) {
+            u64 w = rewind_word(state, i) ^ rewind_word(in, 0);
+            memcpy(state + i*8, &w, sizeof(w));
+        }
+    }
+}
+
+static rewind_entry_t *rewind_entry(rewind_t *rw, u32 i) {
+    return &rw->entries[(rw->first + i) % rw->max_entries];
+}
+
+// Deltas are useless without their keyframe, so they go with it
+static void rewind_drop_oldest(rewind_t *rw) {
+    do {
+        rw->first = (rw->first + 1) % rw->max_entries;
+        rw->count--;
+    } while (rw->count && !rewind_entry(rw, 0)->key);
+}
+
+// Finds len contiguous bytes after the newest entry, dropping the oldest
+// entries that are in the way
+static u32 rewind_make_room(rewind_t *rw, u32 len) {
+    u32 pos = rw->write_pos;
+    if (pos + len > rw->cap) {
+        // what's left past pos is from the last time around, wrap over it
+        while (rw->count && rewind_entry(rw, 0)->offset >= pos) rewind_drop_oldest(rw);
+        pos = 0;
+    }
+    while (rw->count) {
+        rewind_entry_t *e = rewind_entry(rw, 0);
+        if (e->offset >= pos + len || e->offset + e->len <= pos) break;
+        rewind_drop_oldest(rw);
+    }
+    return pos;
+}
+
+bool rewind_init(rewind_t *rw, size_t bytes, u32 key_interval) {
+    *rw = (rewind_t){0};
+    rw->state_size = (savestate_size() + 7) & ~(size_t)7;
+    // room for the worst case entry, and u16 runs have to cover a state
+    size_t max_packed = rw->state_size + rw->state_size / 2 + 4;
+    if (bytes < 2*max_packed || bytes > UINT32_MAX || rw->state_size / 8 > UINT16_MAX) {
+        log_warn("Rewind buffer of %zu bytes is too small or too large", bytes);
+        return false;
+    }
+    rw->cap = bytes;
+    rw->max_entries = bytes / 64 + 1;
+    rw->key_interval = key_interval ? key_interval : 1;
+    rw->buf = malloc(rw->cap);
+    rw->entries = malloc(rw->max_entries * sizeof(rewind_entry_t));
+    rw->cur = calloc(1, rw->state_size);
+    rw->key = calloc(1, rw->state_size);
+    rw->packed = malloc(max_packed);
+    if (!rw->buf || !rw->entries || !rw->cur || !rw->key || !rw->packed) {
+        log_warn("Could not allocate the rewind buffer");
+        rewind_free(rw);
+        return false;
+    }
+    return true;
+}
+
+void rewind_free(rewind_t *rw) {
+    free(rw->buf);
+    free(rw->entries);
+    free(rw->cur);
+    free(rw->key);
+    free(rw->packed);
+    *rw = (rewind_t){0};
+}
+
+void rewind_push(rewind_t *rw) {
+    savestate_save(rw->cur);
+    bool key = rw->count == 0 || rw->since_key + 1 >= rw->key_interval;
+    u32 len = rewind_pack(rw->packed, rw->cur, key ? NULL : rw->key, rw->state_size);
+
+    if (rw->count == rw->max_entries) rewind_drop_oldest(rw);
+    u32 pos = rewind_make_room(rw, len);
+    if (!key && rw->count == 0) {
+        // the room went to our own keyframe, start over with a new one
+        key = true;
+        len = rewind_pack(rw->packed, rw->cur, NULL, rw->state_size);
+        pos = rewind_make_room(rw, len);
+    }
+
+    memcpy(rw->buf + pos, rw->packed, len);
+    *rewind_entry(rw, rw->count) = (rewind_entry_t){ .offset = pos, .len = len, .key = key };
+    rw->count++;
+    rw->write_pos = pos + len;
+    if (key) {
+        memcpy(rw->key, rw->cur, rw->state_size);
+        rw->since_key = 0;
+    }
+    else rw->since_key++;
+}
+
+u32 rewind_bytes(rewind_t *rw) {
+    u32 bytes = 0;
+    for (u32 i = 0; i < rw->count; i++) bytes += rewind_entry(rw, i)->len;
+    return bytes;
+}
+
+bool rewind_pop(rewind_t *rw) {
+    if (rw->count == 0) return false;
+    rewind_entry_t e = *rewind_entry(rw, rw->count - 1);
+    rewind_unpack(rw->cur, rw->buf + e.offset, e.len, e.key ? NULL : rw->key, rw->state_size);
+    rw->count--;
+    rw->write_pos = e.offset;
+
+    if (e.key) {
+        // go back to the keyframe before it for the deltas in between
+        for (u32 i = rw->count; i > 0; i--) {
+            rewind_entry_t *k = rewind_entry(rw, i - 1);
+            if (!k->key) continue;
+            rewind_unpack(rw->key, rw->buf + k->offset, k->len, NULL, rw->state_size);
+            rw->since_key = rw->count - i;
+            break;
+        }
+    }
+    else rw->since_key--;
+
+    return savestate_load(rw->cur, rw->state_size);
+}
@@ -0,0 +1,53 @@
+// SPDX-License-Identifier: GPL-3.0-or-later
+// Copyright 2024 neov5
+
+#ifndef __REWIND_H__
+#define __REWIND_H__
+
+#include "types.h"
+#include <stdbool.h>
+#include <stddef.h>
+
+// One captured frame in the history. Keyframes are a whole save state, the
+// rest XOR deltas against the keyframe before them. Both are run length
+// coded
+typedef struct {
+    u32 offset;
+    u32 len;
+    bool key;
+} rewind_entry_t;
+
+// History of save states in a fixed amount of memory. The oldest keyframe and
+// its deltas are dropped to make room for new ones
+typedef struct {
+    u8 *buf; // packed entries, each one contiguous
+    u32 cap;
+    u32 write_pos;
+
+    rewind_entry_t *entries; // ring, oldest at first
+    u32 max_entries;
+    u32 first;
+    u32 count;
+
+    size_t state_size;
+    u8 *cur; // scratch save state
+    u8 *key; // the keyframe the newest deltas are against
+    u8 *packed; // scratch for coding an entry
+
+    u32 key_interval;
+    u32 since_key; // entries pushed since the last keyframe
+} rewind_t;
+
+#define REWIND_KEY_INTERVAL 60
+
+bool rewind_init(rewind_t *rw, size_t bytes, u32 key_interval);
+void rewind_free(rewind_t *rw);
+
+// Captures the current state as the newest entry
+void rewind_push(rewind_t *rw);
+// Loads the newest entry and drops it, false when there's no history left
+bool rewind_pop(rewind_t *rw);
+// Bytes the history takes up now
+u32 rewind_bytes(rewind_t *rw);
+
+#endif
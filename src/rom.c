@@ -35,10 +35,12 @@ void rom_load_from_file(rom_t *rom, char* filename) {
     rom->mirror_type = (header[6] & 1) ? HORIZONTAL : VERTICAL;
     if (header[6] & 0x4) fseek(rom_file, 512, SEEK_CUR);
     rom->prg_rom = malloc(rom->prg_rom_size);
-    rom->chr_rom = malloc(rom->chr_rom_size);
+    rom->chr_ram = rom->chr_rom_size == 0;
+    if (rom->chr_ram) rom->chr_rom_size = 0x2000;
+    rom->chr_rom = calloc(rom->chr_rom_size, 1);
 
     fread(rom->prg_rom, rom->prg_rom_size, 1, rom_file);
-    fread(rom->chr_rom, rom->chr_rom_size, 1, rom_file);
+    if (!rom->chr_ram) fread(rom->chr_rom, rom->chr_rom_size, 1, rom_file);
 
     fclose(rom_file);
 
@@ -51,6 +53,9 @@ void rom_load_from_file(rom_t *rom, char* filename) {
                            .ppu_read = &no_mapper_ppu_read,
                            .ppu_write = &no_mapper_ppu_write
                           }; 
+            for (int i=0; i<0x80; i++) {
+                rom->prg_pages[i] = &rom->prg_rom[(i << 8) % rom->prg_rom_size];
+            }
             break;
         // TODO more mappers
         default:
@@ -58,6 +63,33 @@ void rom_load_from_file(rom_t *rom, char* filename) {
             exit(0);
     }
 
+    rom_decode_chr(rom, 0, 0x2000);
+}
+
+// 8 pattern bits spread out to the bottom bit of 8 nibbles, leftmost on top
+static u32 rom_spread(u32 bits) {
+    bits = (bits | (bits << 12)) & 0x000F000F;
+    bits = (bits | (bits << 6))  & 0x03030303;
+    bits = (bits | (bits << 3))  & 0x11111111;
+    return bits;
+}
+
+// same with the rightmost on top
+static u32 rom_spread_flipped(u32 bits) {
+    bits = ((bits >> 4) | (bits << 16)) & 0x000F000F;
+    bits = ((bits >> 2) | (bits << 8))  & 0x03030303;
+    bits = ((bits >> 1) | (bits << 4))  & 0x11111111;
+    return bits;
+}
+
+// each byte redecodes its row with both planes, whole ranges do rows twice
+void rom_decode_chr(rom_t *rom, u16 addr, u32 len) {
+    for (u32 a = addr; a < (u32)addr + len && a < 0x2000; a++) {
+        u32 lo = rom->mapper.ppu_read(rom, a & ~0x8), hi = rom->mapper.ppu_read(rom, a | 0x8);
+        u32 row = (a >> 4) << 3 | (a & 0x7);
+        rom->chr_rows[row] = rom_spread(lo) | rom_spread(hi) << 1;
+        rom->chr_rows_flipped[row] = rom_spread_flipped(lo) | rom_spread_flipped(hi) << 1;
+    }
 }
 
 u8 no_mapper_cpu_read(rom_t *rom, u16 addr) {
@@ -73,7 +105,10 @@ void no_mapper_cpu_write(rom_t *rom, u8 val, u16 addr) {
 }
 
 void no_mapper_ppu_write(rom_t *rom, u8 val, u16 addr) {
-    // not allowed
+    // only CHR-RAM takes writes
+    if (!rom->chr_ram) return;
+    rom->chr_rom[addr % rom->chr_rom_size] = val;
+    rom_decode_chr(rom, addr, 1);
 }
 
 void rom_free(rom_t *rom) {
@@ -5,6 +5,7 @@
 #define __ROM_H__ 
 
 #include "types.h"
+#include <stdbool.h>
 
 struct rom_t;
 struct rom_mapper_t;
@@ -49,10 +50,25 @@ struct rom_t {
     u8 *prg_rom;
     u8 *chr_rom;
     u8 *prg_ram;
+    bool chr_ram; // no CHR-ROM on the cart, chr_rom is 8 kB of RAM instead
+
+    // PRG-ROM behind each 256 byte page of $8000-$FFFF, the mapper keeps
+    // these up to date on bank switches
+    u8 *prg_pages[0x80];
+
+    // Every row of the 512 tiles the PPU sees at $0000-$1FFF, both planes
+    // decoded into 8 pixels of 4 bits (the pattern bits at the bottom,
+    // leftmost pixel on top), and again mirrored for horizontally flipped
+    // sprites. The mapper redecodes what changes on CHR writes and bank
+    // switches
+    u32 chr_rows[0x1000];
+    u32 chr_rows_flipped[0x1000];
 };
 
 void rom_load_from_file(rom_t *rom, char* filename);
 void rom_free(rom_t *rom);
+// Redecodes the tile rows behind PPU $0000-$1FFF addresses addr to addr+len
+void rom_decode_chr(rom_t *rom, u16 addr, u32 len);
 
 u8 no_mapper_cpu_read(rom_t *rom, u16 addr);
 u8 no_mapper_ppu_read(rom_t *rom, u16 addr);
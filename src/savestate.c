@@ -0,0 +1,133 @@
+// SPDX-License-Identifier: GPL-3.0-or-later
+// Copyright 2024 neov5
+
+#include "savestate.h"
+#include "nes.h"
+#include "log.h"
+#include <string.h>
+
+extern nes_state_t state;
+
+static const char MAGIC[4] = { 'B', 'N', 'S', 'T' };
+
+typedef struct {
+    char magic[4];
+    u32 version;
+    u32 size;
+    u32 prg_rom_size;
+    u32 chr_rom_size;
+
+    struct {
+        u64 cycles;
+        u16 PC;
+        u8 A, X, Y, S, P;
+        u8 IRQ, NMI, RST;
+    } cpu;
+
+    ppu_state_t ppu; // bus callbacks and CHR pointers stay as they are on load
+    u8 wram[0x800];
+    u8 apu_io_reg[0x20];
+    u8 vram[0x800];
+    u8 chr_ram[0x2000]; // zeros for carts with CHR-ROM
+
+    joypad_t joypad;
+    dma_oam_t dma_oam;
+    sched_t sched;
+    u64 ppu_cycle;
+    u64 cpu_cycle;
+    bool frame_done;
+} savestate_t;
+
+size_t savestate_size() {
+    return sizeof(savestate_t);
+}
+
+void savestate_save(void *buf) {
+    savestate_t *s = buf;
+    cpu_state_t *cpu = &state.cpu_st;
+
+    // no padding or pointers, so equal states are equal bytes
+    memset(s, 0, sizeof(savestate_t));
+    memcpy(s->magic, MAGIC, sizeof(MAGIC));
+    s->version = SAVESTATE_VERSION;
+    s->size = sizeof(savestate_t);
+    s->prg_rom_size = state.rom.prg_rom_size;
+    s->chr_rom_size = state.rom.chr_rom_size;
+
+    s->cpu.cycles = cpu->cycles;
+    s->cpu.PC = cpu->PC;
+    s->cpu.A = cpu->A;
+    s->cpu.X = cpu->X;
+    s->cpu.Y = cpu->Y;
+    s->cpu.S = cpu->S;
+    s->cpu.P = cpu_get_p(cpu);
+    s->cpu.IRQ = cpu->IRQ;
+    s->cpu.NMI = cpu->NMI;
+    s->cpu.RST = cpu->RST;
+
+    s->ppu = state.ppu_st;
+    s->ppu.bus_read = NULL;
+    s->ppu.bus_write = NULL;
+    s->ppu.chr_rows = s->ppu.chr_rows_flipped = NULL;
+    memcpy(s->wram, state.cpu_mem.wram, sizeof(s->wram));
+    memcpy(s->apu_io_reg, state.cpu_mem.apu_io_reg, sizeof(s->apu_io_reg));
+    memcpy(s->vram, state.ppu_mem.vram, sizeof(s->vram));
+    if (state.rom.chr_ram) memcpy(s->chr_ram, state.rom.chr_rom, sizeof(s->chr_ram));
+
+    s->joypad = state.joypad;
+    s->dma_oam = state.dma_oam;
+    s->sched = state.sched;
+    s->ppu_cycle = state.ppu_cycle;
+    s->cpu_cycle = state.cpu_cycle;
+    s->frame_done = state.frame_done;
+}
+
+bool savestate_load(const void *buf, size_t len) {
+    const savestate_t *s = buf;
+    cpu_state_t *cpu = &state.cpu_st;
+
+    if (len < sizeof(savestate_t) || memcmp(s->magic, MAGIC, sizeof(MAGIC)) != 0 ||
+        s->version != SAVESTATE_VERSION || s->size != sizeof(savestate_t)) {
+        log_warn("Save state is corrupted or from another version");
+        return false;
+    }
+    if (s->prg_rom_size != state.rom.prg_rom_size || s->chr_rom_size != state.rom.chr_rom_size) {
+        log_warn("Save state is for another ROM");
+        return false;
+    }
+
+    cpu->cycles = s->cpu.cycles;
+    cpu->PC = s->cpu.PC;
+    cpu->A = s->cpu.A;
+    cpu->X = s->cpu.X;
+    cpu->Y = s->cpu.Y;
+    cpu->S = s->cpu.S;
+    cpu_set_p(cpu, s->cpu.P);
+    cpu->IRQ = s->cpu.IRQ;
+    cpu->NMI = s->cpu.NMI;
+    cpu->RST = s->cpu.RST;
+    cpu->idle_count = 0; // a loop has to prove itself idle again
+
+    ppu_state_t ppu = state.ppu_st;
+    state.ppu_st = s->ppu;
+    state.ppu_st.bus_read = ppu.bus_read;
+    state.ppu_st.bus_write = ppu.bus_write;
+    state.ppu_st.chr_rows = ppu.chr_rows;
+    state.ppu_st.chr_rows_flipped = ppu.chr_rows_flipped;
+    ppu_oam_changed();
+    memcpy(state.cpu_mem.wram, s->wram, sizeof(s->wram));
+    memcpy(state.cpu_mem.apu_io_reg, s->apu_io_reg, sizeof(s->apu_io_reg));
+    memcpy(state.ppu_mem.vram, s->vram, sizeof(s->vram));
+    if (state.rom.chr_ram) {
+        memcpy(state.rom.chr_rom, s->chr_ram, sizeof(s->chr_ram));
+        rom_decode_chr(&state.rom, 0, 0x2000);
+    }
+
+    state.joypad = s->joypad;
+    state.dma_oam = s->dma_oam;
+    state.sched = s->sched;
+    state.ppu_cycle = s->ppu_cycle;
+    state.cpu_cycle = s->cpu_cycle;
+    state.frame_done = s->frame_done;
+    return true;
+}
@@ -0,0 +1,22 @@
+// SPDX-License-Identifier: GPL-3.0-or-later
+// Copyright 2024 neov5
+
+#ifndef __SAVESTATE_H__
+#define __SAVESTATE_H__
+
+#include "types.h"
+#include <stdbool.h>
+#include <stddef.h>
+
+// Bump whenever what goes into a save state changes
+#define SAVESTATE_VERSION 5
+
+// Save states hold only what the emulation changes as it runs (registers,
+// RAM, VRAM, CHR-RAM, ppu internals, the schedule), not the ROM, callbacks or
+// caches. They are a flat copy of a few structs, so they're only good for the
+// build that made them. buf has to be aligned like malloc's
+size_t savestate_size();
+void savestate_save(void *buf);
+bool savestate_load(const void *buf, size_t len);
+
+#endif
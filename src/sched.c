@@ -0,0 +1,40 @@
+// SPDX-License-Identifier: GPL-3.0-or-later
+// Copyright 2024 neov5
+
+#include "sched.h"
+
+// there are only a handful of events, a scan beats keeping a heap
+static void sched_update_next(sched_t *s) {
+    s->next = SCHED_NEVER;
+    for (int i=0; i<SCHED_NUM_EVENTS; i++) {
+        if (s->when[i] < s->next) s->next = s->when[i];
+    }
+}
+
+void sched_init(sched_t *s) {
+    for (int i=0; i<SCHED_NUM_EVENTS; i++) s->when[i] = SCHED_NEVER;
+    s->next = SCHED_NEVER;
+}
+
+void sched_set(sched_t *s, sched_event_t ev, u64 when) {
+    s->when[ev] = when;
+    if (when < s->next) s->next = when;
+    else sched_update_next(s);
+}
+
+void sched_cancel(sched_t *s, sched_event_t ev) {
+    sched_set(s, ev, SCHED_NEVER);
+}
+
+// Takes the first event that is due by now off the queue, false if none is
+bool sched_pop_due(sched_t *s, u64 now, sched_event_t *ev) {
+    if (s->next > now) return false;
+    for (int i=0; i<SCHED_NUM_EVENTS; i++) {
+        if (s->when[i] <= now) {
+            *ev = i;
+            sched_cancel(s, i);
+            return true;
+        }
+    }
+    return false;
+}
@@ -0,0 +1,39 @@
+// SPDX-License-Identifier: GPL-3.0-or-later
+// Copyright 2024 neov5
+
+#ifndef __SCHED_H__
+#define __SCHED_H__
+
+#include <stdbool.h>
+
+#include "types.h"
+
+// Events on the system clock, timestamped in cpu cycles. The cpu runs
+// uninterrupted until the earliest one is due, so anything that has to happen
+// at a point in time (interrupts, DMA, catching a device up) goes in here
+// instead of being polled for. Mapper IRQs and the APU frame counter get
+// their own events once they exist.
+//
+// Events that are due at the same time fire in the order they are listed in
+
+typedef enum {
+    SCHED_VBLANK_START, // ppu reaches (241, 1), frame is done
+    SCHED_NMI,          // ppu reaches (241, 4) and raises NMI if enabled
+    SCHED_VBLANK_END,   // ppu reaches (261, 1)
+    SCHED_DMA,          // OAM DMA halts the cpu
+    SCHED_NUM_EVENTS
+} sched_event_t;
+
+#define SCHED_NEVER UINT64_MAX
+
+typedef struct {
+    u64 when[SCHED_NUM_EVENTS]; // SCHED_NEVER if not pending
+    u64 next; // earliest of when
+} sched_t;
+
+void sched_init(sched_t *s);
+void sched_set(sched_t *s, sched_event_t ev, u64 when);
+void sched_cancel(sched_t *s, sched_event_t ev);
+bool sched_pop_due(sched_t *s, u64 now, sched_event_t *ev);
+
+#endif